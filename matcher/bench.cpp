@@ -0,0 +1,435 @@
+#include <iostream>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <random>
+#include <unordered_set>
+#include <new>
+#include <atomic>
+#include <sys/resource.h>
+#include "matcher.hpp"
+#include "bk_tree.hpp"
+#include "translation_graph.hpp"
+
+using namespace std;
+
+// The benchmarks of the hot functions of the matcher and of the whole pipeline, reported as ns/op, ops/s and allocations/op
+// and written as JSON, so that builds can be compared.
+// The size of the corpus (rows, medicines, words, the depth of the BK-Tree and the peak memory) is written along,
+// so that the runs over the synthetic corpora of parser/synthetic.py chart the scaling against the size.
+// Example: ./benchmark ../meds/en_meds.csv bench.json
+//          for s in 1 2 5 10; do python3 ../parser/synthetic.py --scale $s --output ../meds/synthetic/$s --meds ../meds;
+//            ./benchmark ../meds/synthetic/$s/en_meds.csv bench.$s.json ../meds/synthetic/$s; done
+
+#define MIN_BENCH_TIME 0.25
+#define SYNTHETIC_COUNT 10000
+
+// Count the allocations. The benchmarks run on a single thread, but the index is built on all cores
+static atomic<uint64_t> allocationCount(0);
+
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, memory_order_relaxed);
+  if (void* ptr = malloc(size ? size : 1))
+    return ptr;
+  throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+// Not inlined: GCC would then see the pointers of 'operator new' freed, and warn (-Wmismatched-new-delete)
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+__attribute__((noinline)) void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+// Keeps the results of the benchmarked functions alive
+static volatile uint64_t sink = 0;
+
+struct benchResult {
+  string name;
+  string input;
+  string unit;
+  uint64_t ops;
+  double seconds;
+  uint64_t allocations;
+};
+
+vector<benchResult> results;
+
+// The size of the corpus
+struct corpusStats {
+  uint64_t rows = 0, medicines = 0, words = 0;
+  uint32_t maxDepth = 0;
+  double meanDepth = 0;
+  long peakKilobytes = 0;
+} corpus;
+
+void report(const benchResult& r) {
+  double nsPerOp = r.seconds * 1e9 / r.ops;
+  cerr << left << setw(40) << r.name << setw(12) << r.input << right << fixed
+       << setw(12) << setprecision(1) << nsPerOp << " ns/" << r.unit
+       << setw(14) << setprecision(0) << (r.ops / r.seconds) << " " << r.unit << "s/s"
+       << setw(10) << setprecision(2) << (double(r.allocations) / r.ops) << " allocs/" << r.unit << endl;
+  results.push_back(r);
+}
+
+// Run 'op(input)' over all 'inputs', round after round, until at least MIN_BENCH_TIME seconds have passed
+template <typename Input, typename Op>
+void bench(const string& name, const string& inputName, const vector<Input>& inputs, Op&& op) {
+  if (inputs.empty())
+    return;
+  // Warm up
+  for (auto& input : inputs)
+    sink += op(input);
+
+  uint64_t ops = 0, allocations = allocationCount;
+  auto start = chrono::steady_clock::now();
+  double seconds = 0;
+  do {
+    for (auto& input : inputs)
+      sink += op(input);
+    ops += inputs.size();
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  } while (seconds < MIN_BENCH_TIME);
+  report({name, inputName, "op", ops, seconds, allocationCount - allocations});
+}
+
+void writeJson(const string& fileName) {
+  ofstream out(fileName);
+  out << "{\n  \"corpus\": {\"rows\": " << corpus.rows << ", \"medicines\": " << corpus.medicines << ", \"words\": " << corpus.words
+      << ", \"max_depth\": " << corpus.maxDepth << fixed << setprecision(3) << ", \"mean_depth\": " << corpus.meanDepth
+      << ", \"peak_rss_kb\": " << corpus.peakKilobytes << "},\n";
+  out << "  \"benchmarks\": [\n";
+  for (size_t index = 0; index != results.size(); ++index) {
+    auto& r = results[index];
+    out << "    {\"name\": \"" << r.name << "\", \"input\": \"" << r.input << "\", \"unit\": \"" << r.unit << "\", \"ops\": " << r.ops
+        << fixed << setprecision(3) << ", \"ns_per_op\": " << (r.seconds * 1e9 / r.ops) << ", \"ops_per_s\": " << (r.ops / r.seconds)
+        << ", \"allocs_per_op\": " << (double(r.allocations) / r.ops) << "}" << ((index + 1 != results.size()) ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+}
+
+// Perturb 'word' by up to 'edits' random insertions, deletions or substitutions
+string perturb(string word, unsigned edits, mt19937& rng) {
+  for (unsigned edit = 0; edit != edits; ++edit) {
+    size_t pos = rng() % (word.size() + 1);
+    char c = 'a' + rng() % 26;
+    switch (rng() % 3) {
+      case 0: word.insert(word.begin() + pos, c); break;
+      case 1: if (pos < word.size()) word.erase(pos, 1); break;
+      default: if (pos < word.size()) word[pos] = c;
+    }
+  }
+  return word;
+}
+
+int main(int argc, char** argv) {
+  string databankFileName = (argc > 1) ? argv[1] : "../meds/en_meds.csv";
+  string jsonFileName = (argc > 2) ? argv[2] : "bench.json";
+  if (argc > 3)
+    medsDirectory() = string(argv[3]) + "/";
+
+  ifstream in(databankFileName);
+  if (!in.is_open()) {
+    cerr << "file \"" << databankFileName << "\" could not open" << endl;
+    exit(1);
+  }
+  VS lines;
+  for (string line; getline(in, line); )
+    lines.push_back(line);
+
+  // Building the index
+  medSnapshot index;
+  {
+    uint64_t allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    buildIndex("de", hashFile(medsFileName("de")), index);
+    report({"buildIndex", "de_meds", "op", 1, chrono::duration<double>(chrono::steady_clock::now() - start).count(), allocationCount - allocations});
+  }
+  deletionIndex deletions;
+  {
+    uint64_t allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    deletions.build(index.tree(), SEARCH_PRECISION);
+    report({"deletion_index::build", "de_meds", "op", 1, chrono::duration<double>(chrono::steady_clock::now() - start).count(), allocationCount - allocations});
+  }
+  auto& tree = index.tree();
+
+  // The depth of the BK-Tree, walked from its root (node 0) a level at a time
+  corpus.rows = lines.size();
+  corpus.medicines = index.medicineCount();
+  corpus.words = tree.size();
+  if (tree.size()) {
+    uint64_t depthSum = 0;
+    VI level = {0}, next;
+    for (uint32_t depth = 0; !level.empty(); ++depth, level.swap(next)) {
+      next.clear();
+      for (auto id : level) {
+        auto& node = tree.nodes()[id];
+        for (uint32_t child = 0; child != node.n_children; ++child)
+          next.push_back(tree.edges()[node.first_child + child].child);
+      }
+      corpus.maxDepth = depth;
+      depthSum += uint64_t(depth) * level.size();
+    }
+    corpus.meanDepth = double(depthSum) / tree.size();
+  }
+
+  // The inputs: real words of the vocabulary and their misspellings (which are not in the vocabulary), random strings, and the rows.
+  // Without words, or without misspellings, the benchmarks over them are skipped as those over empty inputs
+  mt19937 rng(42);
+  VS vocabulary, misspelled, synthetic;
+  for (uint32_t count = 0; count != SYNTHETIC_COUNT; ++count) {
+    if (tree.size()) {
+      string word(tree.key(rng() % tree.size()));
+      vocabulary.push_back(word);
+      string typo = perturb(word, 1 + rng() % 2, rng);
+      if (index.find(typo) == medSnapshot::npos)
+        misspelled.push_back(typo);
+    }
+    string random(MIN_LEN + rng() % 12, ' ');
+    for (auto& c : random)
+      c = 'a' + rng() % 26;
+    synthetic.push_back(random);
+  }
+  vector<pair<string, string>> realPairs, syntheticPairs;
+  for (uint32_t count = 0; count != SYNTHETIC_COUNT; ++count) {
+    if (!misspelled.empty())
+      realPairs.emplace_back(vocabulary[count], misspelled[count % misspelled.size()]);
+    syntheticPairs.emplace_back(synthetic[count], synthetic[(count * 7 + 1) % synthetic.size()]);
+  }
+  VS commonNames;
+  for (auto& line : lines) {
+    auto name = analyzeLine(line).first;
+    if (!name.empty())
+      commonNames.push_back(strToLower(name));
+  }
+
+  // The distance kernels
+  for (auto [pairs, inputName] : {make_pair(&realPairs, "real"), make_pair(&syntheticPairs, "synthetic")}) {
+    bench("levenshteinDistance", inputName, *pairs, [](const pair<string, string>& p) {
+      return levenshteinDistance()(p.first, p.second);
+    });
+    bench("bitParallelLevenshtein", inputName, *pairs, [](const pair<string, string>& p) {
+      return bitParallelLevenshtein()(p.first, p.second);
+    });
+    bench("bitParallelLevenshtein(bound=1)", inputName, *pairs, [](const pair<string, string>& p) {
+      return bitParallelLevenshtein()(p.first, p.second, SEARCH_PRECISION);
+    });
+  }
+
+  // The fuzzy searches, with the pointer-based tree of bk_tree.hpp as baseline
+  storage::bktree<string, uint32_t, bitParallelLevenshtein> pointerTree;
+  for (uint32_t id = 0; id != tree.size(); ++id)
+    pointerTree.insert(string(tree.key(id)));
+  treeMatches devs;
+  for (auto [queries, inputName] : {make_pair(&misspelled, "misspelled"), make_pair(&synthetic, "synthetic")}) {
+    bench("bktree::find_within", inputName, *queries, [&pointerTree](const string& query) {
+      return pointerTree.find_within(query, SEARCH_PRECISION).size();
+    });
+    bench("flat_bktree_view::find_within", inputName, *queries, [&tree, &devs](const string& query) {
+      devs.clear();
+      tree.find_within(devs, query, SEARCH_PRECISION);
+      return devs.size();
+    });
+    bench("flat_bktree_view::find_within_frontier", inputName, *queries, [&tree, &devs](const string& query) {
+      devs.clear();
+      tree.find_within_frontier(devs, query, SEARCH_PRECISION);
+      return devs.size();
+    });
+    bench("deletion_index::find_within", inputName, *queries, [&deletions, &devs](const string& query) {
+      devs.clear();
+      deletions.find_within(devs, query, SEARCH_PRECISION);
+      return devs.size();
+    });
+  }
+
+  // The same searches as one join of all queries against the vocabulary (per query)
+  similarityJoin join(tree, SEARCH_PRECISION);
+  for (auto [queries, inputName] : {make_pair(&misspelled, "misspelled"), make_pair(&synthetic, "synthetic")}) {
+    if (queries->empty())
+      continue;
+    vector<string_view> keys(queries->begin(), queries->end());
+    uint64_t ops = 0, allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    double seconds = 0;
+    do {
+      join.join(keys);
+      sink += join.pairs();
+      ops += keys.size();
+      seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (seconds < MIN_BENCH_TIME);
+    report({"similarity_join::join", inputName, "op", ops, seconds, allocationCount - allocations});
+  }
+
+  // Scanning the posting lists, plain and delta+varint encoded
+  medSnapshot compressedIndex;
+  buildIndex("de", hashFile(medsFileName("de")), compressedIndex, postingFormat::varint);
+  vector<uint32_t> wordIds(tree.size());
+  iota(wordIds.begin(), wordIds.end(), 0);
+  for (auto [snapshot, inputName] : {make_pair(&index, "plain"), make_pair(&compressedIndex, "varint")}) {
+    cerr << "posting lists (" << inputName << "): " << snapshot->postingBytes() << " bytes" << endl;
+    bench("medSnapshot::postings", inputName, wordIds, [snapshot](uint32_t word) {
+      uint64_t sum = 0;
+      for (auto row : snapshot->postings(word))
+        sum += row;
+      return sum;
+    });
+  }
+
+  // Reading the rows, with getline or with the mapped CSV reader (en_meds.csv, and the raw vocabulary if found next to it)
+  VS databankFiles = {databankFileName};
+  if (ifstream("../drugbank_vocabulary.csv").is_open())
+    databankFiles.push_back("../drugbank_vocabulary.csv");
+  bench("readRows(getline)", "en_meds", VS{databankFileName}, [](const string& fileName) {
+    ifstream input(fileName);
+    size_t count = 0;
+    for (string line; getline(input, line); )
+      count += line.size();
+    return count;
+  });
+  for (auto& fileName : databankFiles) {
+    bench("readRows(drugbankReader)", (fileName == databankFileName) ? "en_meds" : "vocabulary", VS{fileName}, [](const string& fileName) {
+      drugbankReader reader;
+      reader.open(fileName);
+      size_t count = 0;
+      for (drugbankRecord row; reader.next(row); )
+        count += row.synonyms.size();
+      return count;
+    });
+  }
+
+  // Parsing
+  bench("analyzeLine", "en_meds", lines, [](const string& line) {
+    return analyzeLine(line).second.first.size();
+  });
+  bench("parseRow", "en_meds", lines, [](const string& line) {
+    return parseRow(line).synonyms.size();
+  });
+  vector<drugbankRecord> records;
+  drugbankReader reader;
+  reader.open(databankFileName);
+  for (drugbankRecord row; reader.next(row); )
+    records.push_back(row);
+  bench("parseRecord", "en_meds", records, [](const drugbankRecord& row) {
+    return parseRecord(row).synonyms.size();
+  });
+  bench("splitUp(EN)", "en_meds", commonNames, [](const string& name) {
+    return splitUp(name, SplitMode::EN).size();
+  });
+  bench("splitUp(EN_PRICE)", "en_meds", commonNames, [](const string& name) {
+    return splitUp(name, SplitMode::EN_PRICE).size();
+  });
+  bench("forEachPart(EN)", "en_meds", commonNames, [](const string& name) {
+    size_t count = 0;
+    forEachPart(name, SplitMode::EN, [&count](string_view) { ++count; });
+    return count;
+  });
+
+  // The whole pipeline over the rows, in batches as in 'match' (and ranked, keeping the 3 best rows)
+  struct pipelineCase {
+    const deletionIndex* fuzzyIndex;
+    uint32_t topK;
+    const char* name;
+  };
+  for (auto [fuzzyIndex, topK, name] : {pipelineCase{nullptr, 0, "pipeline(bktree)"}, pipelineCase{&deletions, 0, "pipeline(deletion)"},
+                                        pipelineCase{&deletions, 3, "pipeline(deletion, top-3)"}}) {
+    Matcher matcher(index, fuzzyIndex);
+    matcher.rankTop(topK);
+    vector<Matcher::result> matched;
+    vector<string_view> queries(lines.begin(), lines.end());
+    uint64_t allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    for (size_t first = 0; first < queries.size(); first += BATCH_SIZE) {
+      matched.clear();
+      matcher.matchRows(queries.data() + first, min<size_t>(BATCH_SIZE, queries.size() - first), matched);
+      sink += matched.size();
+    }
+    report({name, "en_meds", "row", queries.size(), chrono::duration<double>(chrono::steady_clock::now() - start).count(), allocationCount - allocations});
+  }
+
+  // The same, with all rows parsed first and their distinct parts joined against the vocabulary (as 'match --fuzzy join')
+  {
+    Matcher matcher(index, &deletions);
+    vector<Matcher::result> matched;
+    vector<string_view> queries;
+    uint64_t allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    vector<parsedRow> parsed;
+    unordered_set<string_view> parts;
+    for (auto& row : records) {
+      queries.push_back(row.record);
+      parsed.push_back(parseRecord(row));
+      forEachSearchedPart(parsed.back(), [&parts](string_view part) { parts.insert(part); });
+    }
+    vector<string_view> unknown;
+    for (auto part : parts)
+      if (index.find(part) == medSnapshot::npos)
+        unknown.push_back(part);
+    join.join(move(unknown));
+    matcher.useJoin(&join);
+    for (size_t first = 0; first < queries.size(); first += BATCH_SIZE) {
+      matched.clear();
+      matcher.matchRows(queries.data() + first, parsed.data() + first, min<size_t>(BATCH_SIZE, queries.size() - first), matched);
+      sink += matched.size();
+    }
+    report({"pipeline(join)", "en_meds", "row", queries.size(), chrono::duration<double>(chrono::steady_clock::now() - start).count(), allocationCount - allocations});
+  }
+
+  // The queries of the translator on its binary graph, built from the matching of the benchmarked rows
+  // (en_meds.csv takes its ids from the raw vocabulary, if found next to it; without ids, the benchmark is skipped)
+  vector<VI> matchedRows(records.size());
+  {
+    Matcher matcher(index, &deletions);
+    vector<Matcher::result> matched;
+    vector<string_view> queries;
+    vector<parsedRow> parsed;
+    for (auto& row : records) {
+      queries.push_back(row.record);
+      parsed.push_back(parseRecord(row));
+    }
+    for (size_t first = 0; first < queries.size(); first += BATCH_SIZE) {
+      matched.clear();
+      matcher.matchRows(queries.data() + first, parsed.data() + first, min<size_t>(BATCH_SIZE, queries.size() - first), matched);
+      for (auto& result : matched)
+        matchedRows[first + result.query].push_back(result.row);
+    }
+  }
+  translationGraph graph;
+  string vocabularyFileName = ((!hasDrugbankIds(databankFileName)) && (databankFiles.size() > 1)) ? databankFiles.back() : string();
+  if (buildTranslationGraph("de", databankFileName, vocabularyFileName, move(matchedRows), graph)) {
+    scoringWorkspace scores;
+    VI best;
+    bench("translationGraph::query", "en_meds", commonNames, [&graph, &scores, &best](const string& name) {
+      graph.query(translationGraph::english, name, scores, best);
+      return best.size();
+    });
+  } else {
+    cerr << "translationGraph::query skipped: no Drugbank ids" << endl;
+  }
+
+  rusage usage;
+  if (!getrusage(RUSAGE_SELF, &usage))
+    corpus.peakKilobytes = usage.ru_maxrss;
+  cerr << "corpus: " << corpus.rows << " rows, " << corpus.medicines << " medicines, " << corpus.words << " words, BK-Tree depth "
+       << corpus.maxDepth << " (mean " << setprecision(2) << corpus.meanDepth << "), peak RSS " << corpus.peakKilobytes << " kB" << endl;
+  writeJson(jsonFileName);
+  cerr << "Results written to " << jsonFileName << endl;
+  return 0;
+}
@@ -22,11 +22,22 @@
 #include <map>
 #include <cmath>
 #include <vector>
+#include <utility>
+#include <type_traits>
 
 namespace storage {
 
 namespace detail {
 
+/* Detects whether 'Distance' offers a bounded call 'd(ki, kj, bound)', allowed to return any value above 'bound' once exceeded */
+template <typename KeyType, typename MetricType, typename Distance, typename = void>
+struct is_bounded_distance : std::false_type { };
+
+template <typename KeyType, typename MetricType, typename Distance>
+struct is_bounded_distance<KeyType, MetricType, Distance, std::void_t<decltype(
+	std::declval<Distance &>()(std::declval<const KeyType &>(), std::declval<const KeyType &>(), std::declval<MetricType>()))>>
+	: std::true_type { };
+
 template <typename KeyType, typename MetricType, typename Distance>
 class tree_node
 {
@@ -36,10 +47,12 @@ private:
 private:
 	KeyType value;
 	std::map<MetricType, NodeType *> *children;
+	/* an erased node keeps routing the searches (its children hang below it), but is no longer reported */
+	bool erased;
 
 public:
 	tree_node(const KeyType &key)
-		: value(key), children(NULL) { }
+		: value(key), children(NULL), erased(false) { }
 
 	~tree_node() {
 		if (children) {
@@ -50,14 +63,20 @@ public:
 	}
 
 public:
+	/* takes the ownership of 'node', which is deleted if not linked into the tree */
 	bool insert(NodeType *node) {
 		if (!node)
 			return false;
 
 		Distance d;
 		MetricType distance = d(node->value, this->value);
-		if (distance == 0)
-			return false; /* value already exists */
+		if (distance == 0) {
+			delete node;
+			if (!erased)
+				return false; /* value already exists */
+			erased = false; /* revive the erased value */
+			return true;
+		}
 
 		if (!children)
 			children = new std::map<MetricType, NodeType *>();
@@ -71,6 +90,22 @@ public:
 		return iterator->second->insert(node);
 	}
 
+	/* mark the node of 'key' as erased */
+	bool erase(const KeyType &key) {
+		Distance d;
+		MetricType distance = d(key, this->value);
+		if (distance == 0) {
+			if (erased)
+				return false;
+			erased = true;
+			return true;
+		}
+		if (!children)
+			return false;
+		auto iterator = children->find(distance);
+		return (iterator != children->end()) && iterator->second->erase(key);
+	}
+
 protected:
 	bool has_children() const {
 		return this->children && this->children->size();
@@ -79,8 +114,15 @@ protected:
 protected:
 	void _find_within(std::vector<std::pair<KeyType, MetricType>> &result, const KeyType &key, MetricType d) const {
 		Distance f;
-		MetricType n = f(key, this->value);
-		if (n <= d)
+		MetricType n;
+		if constexpr (is_bounded_distance<KeyType, MetricType, Distance>::value) {
+			/* beyond the largest edge plus 'd', neither this node nor any child can qualify */
+			MetricType bound = d + (this->has_children() ? children->rbegin()->first : 0);
+			n = f(key, this->value, bound);
+		} else {
+			n = f(key, this->value);
+		}
+		if (n <= d && !erased)
 			result.push_back(std::make_pair(this->value, n));
 
 		if (!this->has_children())
@@ -88,7 +130,7 @@ protected:
 
 		for (auto iter = children->begin(); iter != children->end(); ++iter) {
 			MetricType distance = iter->first;
-			if (n - d <= distance && distance <= n + d)
+			if (distance + d >= n && distance <= n + d)
 				iter->second->_find_within(result, key, d);
 		}
 	}
@@ -104,7 +146,7 @@ public:
 	void dump_tree(int depth = 0) {
 		for (int i = 0; i < depth; ++i)
 			std::cout << "    ";
-		std::cout << this->value << std::endl;
+		std::cout << this->value << (erased ? " (erased)" : "") << std::endl;
 		if (this->has_children())
 			for (auto iter = children->begin(); iter != children->end(); ++iter)
 				iter->second->dump_tree(depth + 1);
@@ -142,19 +184,34 @@ public:
 	bktree() : m_top(NULL), m_n_nodes(0) { }
 
 public:
-	void insert(const KeyType &key) {
+	bool insert(const KeyType &key) {
 		NodeType *node = new NodeType(key);
 		if (!m_top) {
 			m_top = node;
 			m_n_nodes = 1;
-			return;
+			return true;
 		}
-		if (m_top->insert(node))
-			++m_n_nodes;
+		if (!m_top->insert(node))
+			return false;
+		++m_n_nodes;
+		return true;
 	};
 
+	/*
+	 * Erase 'key' by leaving a tombstone: the node stays in place to route the searches through it,
+	 * and inserting the key again revives it
+	 */
+	bool erase(const KeyType &key) {
+		if (!m_top || !m_top->erase(key))
+			return false;
+		--m_n_nodes;
+		return true;
+	}
+
 public:
 	std::vector<std::pair<KeyType, MetricType>> find_within(KeyType key, MetricType d) const {
+		if (!m_top)
+			return std::vector<std::pair<KeyType, MetricType>>();
 		return m_top->find_within(key, d);
 	}
 
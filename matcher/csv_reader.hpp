@@ -0,0 +1,142 @@
+#ifndef _CSV_READER_HPP_
+#define _CSV_READER_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Zero-copy reading of CSV files (RFC 4180): the file is mapped, and the fields of the records are views into the mapping.
+// Fields are separated by ',' and records by a newline ("\r\n" as well); a field may be quoted with '"', in which case it may hold
+// separators and newlines, and a quote in it is doubled. A quoted field is viewed without its enclosing quotes,
+// its doubled quotes being kept as they are (they are rare, and the callers which care drop the quotes anyway).
+
+// A read-only mapping of a whole file
+class mappedFile {
+  const char* base = nullptr;
+  size_t size_ = 0;
+
+  void release() {
+    if (size_)
+      munmap(const_cast<char*>(base), size_);
+    base = nullptr;
+    size_ = 0;
+  }
+
+  public:
+  mappedFile() = default;
+  mappedFile(const mappedFile&) = delete;
+  mappedFile& operator=(const mappedFile&) = delete;
+  ~mappedFile() { release(); }
+
+  bool open(const std::string& fileName) {
+    release();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      return false;
+    }
+    // An empty file can not be mapped, but is fine
+    if (info.st_size) {
+      void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        close(fd);
+        return false;
+      }
+      madvise(addr, info.st_size, MADV_SEQUENTIAL);
+      base = static_cast<const char*>(addr);
+      size_ = info.st_size;
+    }
+    close(fd);
+    return true;
+  }
+
+  std::string_view bytes() const {
+    return std::string_view(base, size_);
+  }
+};
+
+// Parse the record starting at 'pos' of 'data' into 'fields' and move 'pos' past it. Returns the bytes of the record (without its newline)
+inline std::string_view parseCsvRecord(std::string_view data, size_t& pos, std::vector<std::string_view>& fields) {
+  fields.clear();
+  const size_t begin = pos, size = data.size();
+  size_t end = pos, lineEnd = 0;
+  bool lineKnown = false;
+  for (;;) {
+    if ((pos != size) && (data[pos] == '"')) {
+      // A quoted field runs up to the quote which is not doubled
+      size_t first = ++pos;
+      for (;;) {
+        auto quote = static_cast<const char*>(memchr(data.data() + pos, '"', size - pos));
+        pos = quote ? quote - data.data() : size;
+        if ((pos == size) || (pos + 1 == size) || (data[pos + 1] != '"'))
+          break;
+        pos += 2;
+      }
+      fields.push_back(data.substr(first, pos - first));
+      if (pos != size)
+        ++pos;
+      // Anything up to the next separator is not part of the field
+      while ((pos != size) && (data[pos] != ',') && (data[pos] != '\n'))
+        ++pos;
+    } else {
+      // An unquoted field runs up to the next separator, which is searched with memchr within the rest of the line
+      size_t first = pos;
+      if ((!lineKnown) || (lineEnd < pos)) {
+        lineKnown = true;
+        auto newline = static_cast<const char*>(memchr(data.data() + pos, '\n', size - pos));
+        lineEnd = newline ? newline - data.data() : size;
+      }
+      auto comma = static_cast<const char*>(memchr(data.data() + pos, ',', lineEnd - pos));
+      pos = comma ? comma - data.data() : lineEnd;
+      size_t last = pos;
+      if ((last != first) && (data[last - 1] == '\r') && ((pos == size) || (data[pos] == '\n')))
+        --last;
+      fields.push_back(data.substr(first, last - first));
+    }
+    end = pos;
+    if ((pos == size) || (data[pos] == '\n'))
+      break;
+    ++pos;
+  }
+  if ((end != begin) && (data[end - 1] == '\r'))
+    --end;
+  if (pos != size)
+    ++pos;
+  return data.substr(begin, end - begin);
+}
+
+// The records of a mapped CSV file
+class csvReader {
+  mappedFile file;
+  size_t pos = 0;
+
+  public:
+  bool open(const std::string& fileName) {
+    pos = 0;
+    return file.open(fileName);
+  }
+
+  // Read the next record into 'fields'; 'record' receives its bytes. Returns false at the end of the file
+  bool next(std::vector<std::string_view>& fields, std::string_view& record) {
+    auto data = file.bytes();
+    if (pos == data.size())
+      return false;
+    record = parseCsvRecord(data, pos, fields);
+    return true;
+  }
+
+  // Start over from the first record
+  void rewind() {
+    pos = 0;
+  }
+};
+
+#endif /* _CSV_READER_HPP_ */
@@ -0,0 +1,254 @@
+/*
+ * Symmetric deletion index: a fuzzy index over the keys of a flat BK-tree, for small radii
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DELETION_INDEX_HPP_
+#define _DELETION_INDEX_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include "flat_bk_tree.hpp"
+
+namespace storage {
+
+namespace detail {
+
+/* FNV-1a of a string with the characters at the positions of 'skip' (sorted, possibly empty) left out */
+inline uint64_t deletion_hash(std::string_view key, const uint32_t *skip, uint32_t n_skip) {
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t i = 0; i != key.size(); ++i) {
+		if (n_skip && *skip == i) {
+			++skip;
+			--n_skip;
+			continue;
+		}
+		hash ^= static_cast<uint8_t>(key[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+/*
+ * Call 'callback(hash)' for the key itself and for each distinct string obtained by deleting up to 'depth' of its characters
+ * (deleting any char of a run gives the same string, thus only the first char of a run is deleted)
+ */
+template <typename Callback>
+void for_each_deletion(std::string_view key, uint32_t depth, Callback &callback, uint32_t *skip, uint32_t n_skip, uint32_t from) {
+	callback(deletion_hash(key, skip, n_skip));
+	if (!depth)
+		return;
+	for (uint32_t i = from; i < key.size(); ++i) {
+		if (i > from && key[i] == key[i - 1])
+			continue;
+		skip[n_skip] = i;
+		for_each_deletion(key, depth - 1, callback, skip, n_skip + 1, i + 1);
+	}
+}
+
+/* the position of each node of 'tree' in its pre-order, the order in which 'find_within' reports the matches */
+template <typename View>
+void pre_order_ranks(const View &tree, std::vector<uint32_t> &ranks) {
+	ranks.assign(tree.size(), 0);
+	std::vector<typename View::node_id> stack;
+	if (tree.size())
+		stack.push_back(0);
+	for (uint32_t rank = 0; !stack.empty(); ++rank) {
+		auto id = stack.back();
+		stack.pop_back();
+		ranks[id] = rank;
+		const auto &n = tree.nodes()[id];
+		for (uint32_t i = n.n_children; i--; )
+			stack.push_back(tree.edges()[n.first_child + i].child);
+	}
+}
+
+} /* namespace detail */
+
+/*
+ * Two keys within Levenshtein distance 'd' share a string obtained by deleting at most 'd' characters from each of them.
+ * The index maps the (hashes of the) deletions of each key of the tree to its node id, thus 'find_within' only probes
+ * the deletions of the query and verifies the few candidates with 'Distance', instead of walking the tree.
+ *
+ * The matches are reported in the same order as 'flat_bktree_view::find_within' (the pre-order of the tree),
+ * so both are interchangeable, including for a key which is itself in the tree (or tombstoned in it).
+ */
+template <
+	typename MetricType,
+	typename Distance
+>
+class deletion_index
+{
+public:
+	typedef flat_bktree_view<MetricType, Distance> view_type;
+	typedef typename view_type::node_id node_id;
+	typedef typename view_type::match match;
+
+private:
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	/* the deletions of a key can not be deeper than this (the recursion keeps the deleted positions on the stack) */
+	static constexpr uint32_t max_depth = 4;
+
+	view_type m_tree;
+	MetricType m_max_distance;
+
+	/* the distinct hashes, with the nodes having each of them in m_nodes[m_offsets[h] .. m_offsets[h + 1]) */
+	std::vector<uint64_t> m_hashes;
+	std::vector<uint32_t> m_offsets;
+	std::vector<node_id> m_nodes;
+
+	/* open addressing over 'm_hashes' */
+	std::vector<uint32_t> m_slots;
+	uint64_t m_mask;
+
+	/* the position of each node in the pre-order of the tree */
+	std::vector<uint32_t> m_rank;
+
+public:
+	deletion_index() : m_max_distance(0), m_mask(0) { }
+
+	/* index the keys of 'tree', for queries with a radius up to 'max_distance' */
+	explicit deletion_index(const view_type &tree, MetricType max_distance = 1) {
+		build(tree, max_distance);
+	}
+
+	void build(const view_type &tree, MetricType max_distance = 1) {
+		assert(max_distance <= max_depth);
+		m_tree = tree;
+		m_max_distance = max_distance;
+
+		std::vector<std::pair<uint64_t, node_id>> entries;
+		uint32_t skip[max_depth];
+		for (node_id id = 0; id != tree.size(); ++id) {
+			/* the tombstones of erased keys only route the searches of the tree */
+			if (tree.erased(id))
+				continue;
+			auto add = [&entries, id](uint64_t hash) { entries.emplace_back(hash, id); };
+			detail::for_each_deletion(tree.key(id), max_distance, add, skip, 0, 0);
+		}
+		std::sort(entries.begin(), entries.end());
+		entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+		m_hashes.clear();
+		m_offsets.clear();
+		m_nodes.clear();
+		m_nodes.reserve(entries.size());
+		for (size_t i = 0; i != entries.size(); ++i) {
+			if (!i || entries[i].first != entries[i - 1].first) {
+				m_hashes.push_back(entries[i].first);
+				m_offsets.push_back(m_nodes.size());
+			}
+			m_nodes.push_back(entries[i].second);
+		}
+		m_offsets.push_back(m_nodes.size());
+
+		uint64_t n_slots = 1;
+		while (n_slots < 2 * uint64_t(m_hashes.size()))
+			n_slots <<= 1;
+		m_mask = n_slots - 1;
+		m_slots.assign(n_slots, npos);
+		for (uint32_t h = 0; h != m_hashes.size(); ++h) {
+			uint64_t slot = m_hashes[h] & m_mask;
+			while (m_slots[slot] != npos)
+				slot = (slot + 1) & m_mask;
+			m_slots[slot] = h;
+		}
+
+		detail::pre_order_ranks(tree, m_rank);
+	}
+
+private:
+	/* the nodes having a deletion with hash 'hash' */
+	std::pair<const node_id *, const node_id *> probe(uint64_t hash) const {
+		STATS_COUNT(deletionProbes);
+		for (uint64_t slot = hash & m_mask; m_slots[slot] != npos; slot = (slot + 1) & m_mask) {
+			uint32_t h = m_slots[slot];
+			if (m_hashes[h] == hash)
+				return std::make_pair(m_nodes.data() + m_offsets[h], m_nodes.data() + m_offsets[h + 1]);
+		}
+		return std::make_pair(m_nodes.data(), m_nodes.data());
+	}
+
+public:
+	/* append the matching nodes to 'result' (in the same order as 'flat_bktree_view::find_within'); 'd' is at most the indexed radius */
+	void find_within(std::vector<match> &result, std::string_view key, MetricType d) const {
+		assert(d <= m_max_distance);
+		if (m_slots.empty())
+			return;
+		STATS_QUERY_BEGIN();
+
+		/* collect the candidates right into 'result', then verify them in place */
+		const size_t first = result.size();
+		uint32_t skip[max_depth];
+		auto collect = [this, &result](uint64_t hash) {
+			auto range = probe(hash);
+			for (; range.first != range.second; ++range.first)
+				result.push_back({*range.first, 0});
+		};
+		detail::for_each_deletion(key, d, collect, skip, 0, 0);
+
+		auto by_node = [](const match &a, const match &b) { return a.node < b.node; };
+		std::sort(result.begin() + first, result.end(), by_node);
+		result.erase(std::unique(result.begin() + first, result.end(),
+			[](const match &a, const match &b) { return a.node == b.node; }), result.end());
+
+		Distance f;
+		size_t kept = first;
+		for (size_t i = first; i != result.size(); ++i) {
+			MetricType n;
+			STATS_COUNT(candidates);
+			STATS_COUNT(distancesComputed);
+			if constexpr (detail::is_bounded_distance<std::string_view, MetricType, Distance>::value)
+				n = f(key, m_tree.key(result[i].node), d);
+			else
+				n = f(key, m_tree.key(result[i].node));
+			if (n <= d)
+				result[kept++] = {result[i].node, n};
+		}
+		result.resize(kept);
+
+		std::sort(result.begin() + first, result.end(),
+			[this](const match &a, const match &b) { return m_rank[a.node] < m_rank[b.node]; });
+		STATS_QUERY_END();
+	}
+
+	std::vector<std::pair<std::string, MetricType>> find_within(std::string_view key, MetricType d) const {
+		std::vector<match> matches;
+		find_within(matches, key, d);
+		std::vector<std::pair<std::string, MetricType>> result;
+		result.reserve(matches.size());
+		for (auto &m : matches)
+			result.emplace_back(std::string(m_tree.key(m.node)), m.distance);
+		return result;
+	}
+
+	std::string_view key(node_id id) const {
+		return m_tree.key(id);
+	}
+
+public:
+	size_t size() const {
+		return m_tree.size();
+	}
+};
+
+} /* namespace storage */
+
+#endif /* _DELETION_INDEX_HPP_ */
@@ -0,0 +1,648 @@
+/*
+ * Flat BK-tree: all nodes in one contiguous array, keys in a shared character buffer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FLAT_BK_TREE_HPP_
+#define _FLAT_BK_TREE_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cassert>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "bk_tree.hpp"
+#include "stats.hpp"
+
+namespace storage {
+
+namespace detail {
+
+/* the plain-old-data layout of the flat tree, shared by the in-memory tree and its serialized form */
+struct flat_node {
+	/* set in 'length' once the key has been erased (a tombstone keeps routing the searches, but is no longer reported) */
+	static constexpr uint32_t erased_bit = 0x80000000u;
+
+	uint32_t offset;
+	uint32_t length;
+	uint32_t first_child;
+	uint32_t n_children;
+	/* the character counts of the key (see 'signature_of') */
+	uint64_t signature;
+	/* the same for the subtree of the node (the node included): the union of the signatures and the range of the key lengths */
+	uint64_t subtree_signature;
+	uint32_t min_length, max_length;
+
+	uint32_t key_length() const { return length & ~erased_bit; }
+	bool erased() const { return length & erased_bit; }
+};
+
+/*
+ * The character counts of 'key', in 64 bits: the characters fall into 32 classes (a per lowercase letter, one for the digits,
+ * the others sharing the remaining 5), and the bit of a class in the low half is set once it occurs, in the high half once it recurs
+ */
+inline uint64_t signature_of(std::string_view key) {
+	uint64_t once = 0, twice = 0;
+	for (unsigned char c : key) {
+		unsigned bit = (c >= 'a' && c <= 'z') ? (c - 'a') : ((c >= '0' && c <= '9') ? 26 : (27 + c % 5));
+		twice |= once & (uint64_t(1) << bit);
+		once |= uint64_t(1) << bit;
+	}
+	return once | (twice << 32);
+}
+
+/*
+ * A lower bound on the edit distance between two keys, from their lengths and signatures. An edit changes the length by at most one,
+ * and the count of at most one class either way (thus also the counts capped at two, as in the signatures): each edit takes away
+ * at most one of the counts a key has in excess of the other one
+ */
+inline uint32_t distance_lower_bound(uint32_t length, uint64_t signature, const flat_node &node) {
+	uint32_t other = node.key_length();
+	uint32_t bound = (length > other) ? (length - other) : (other - length);
+	bound = std::max<uint32_t>(bound, __builtin_popcountll(signature & ~node.signature));
+	return std::max<uint32_t>(bound, __builtin_popcountll(node.signature & ~signature));
+}
+
+/*
+ * Whether the search for the keys within 'd' of a key of 'length' and 'signature' can skip 'node' along with its subtree, without
+ * computing a distance: either the distance to the node exceeds 'bound' ('d' plus its largest edge, beyond which neither the node
+ * nor a child qualifies), or no key below it is within 'd' (it would need the counts of the key missing from the whole subtree, or a length out of its range)
+ */
+inline bool rules_out(uint32_t length, uint64_t signature, const flat_node &node, uint32_t d, uint32_t bound) {
+	if ((uint64_t(length) + d < node.min_length) || (length > uint64_t(node.max_length) + d))
+		return true;
+	if (uint32_t(__builtin_popcountll(signature & ~node.subtree_signature)) > d)
+		return true;
+	return distance_lower_bound(length, signature, node) > bound;
+}
+
+template <typename MetricType>
+struct flat_edge {
+	MetricType distance;
+	uint32_t child;
+};
+
+/* Detects whether 'Distance' offers a batched bounded call 'd(key, keys, bounds, distances, count)' (see 'bitParallelLevenshtein') */
+template <typename MetricType, typename Distance, typename = void>
+struct is_batched_distance : std::false_type { };
+
+template <typename MetricType, typename Distance>
+struct is_batched_distance<MetricType, Distance, std::void_t<decltype(
+	std::declval<Distance &>()(std::declval<std::string_view>(), std::declval<const std::string_view *>(),
+		std::declval<const MetricType *>(), std::declval<MetricType *>(), size_t()))>>
+	: std::true_type { };
+
+} /* namespace detail */
+
+/*
+ * Read-only view of a flat BK-tree, over memory owned by somebody else ('flat_bktree' or a mapped file):
+ * - node ids are the insertion order of the (accepted) keys, starting at 0 with the root,
+ * - the keys are (offset, length) pairs into one character buffer,
+ * - the children of a node are a sorted run of (distance, node id) in one edge array,
+ * - erased keys stay in place as tombstones, which are traversed but not reported,
+ * - each node carries the character counts of its key and of its subtree (see 'rules_out'), which let the searches
+ *   skip nodes without computing their distances.
+ */
+template <
+	typename MetricType,
+	typename Distance
+>
+class flat_bktree_view
+{
+public:
+	typedef uint32_t node_id;
+	typedef detail::flat_node node;
+	typedef detail::flat_edge<MetricType> edge;
+
+	struct match {
+		node_id node;
+		MetricType distance;
+	};
+
+private:
+	const char *m_chars;
+	size_t m_n_chars;
+	const node *m_nodes;
+	size_t m_n_nodes;
+	const edge *m_edges;
+	size_t m_n_edges;
+
+public:
+	flat_bktree_view()
+		: m_chars(NULL), m_n_chars(0), m_nodes(NULL), m_n_nodes(0), m_edges(NULL), m_n_edges(0) { }
+
+	flat_bktree_view(const char *chars, size_t n_chars, const node *nodes, size_t n_nodes, const edge *edges, size_t n_edges)
+		: m_chars(chars), m_n_chars(n_chars), m_nodes(nodes), m_n_nodes(n_nodes), m_edges(edges), m_n_edges(n_edges) { }
+
+protected:
+	void _find_within(std::vector<match> &result, std::string_view key, uint64_t signature, MetricType d, node_id id) const {
+		const node &current = m_nodes[id];
+		const edge *first = m_edges + current.first_child, *last = first + current.n_children;
+
+		/* beyond the largest edge plus 'd', neither this node nor any child can qualify: skip it if the signatures tell so already */
+		Distance f;
+		MetricType n;
+		MetricType bound = d + (current.n_children ? last[-1].distance : 0);
+		STATS_COUNT(nodesVisited);
+		if (detail::rules_out(key.size(), signature, current, d, bound)) {
+			STATS_COUNT(signaturesPruned);
+			return;
+		}
+		STATS_COUNT(distancesComputed);
+		if constexpr (detail::is_bounded_distance<std::string_view, MetricType, Distance>::value)
+			n = f(key, this->key(id), bound);
+		else
+			n = f(key, this->key(id));
+		if (n <= d && !current.erased())
+			result.push_back({id, n});
+
+		for (; first != last; ++first) {
+			MetricType distance = first->distance;
+			if (distance + d >= n && distance <= n + d)
+				_find_within(result, key, signature, d, first->child);
+			else
+				STATS_COUNT(childrenPruned);
+		}
+	}
+
+public:
+	/* append the matching nodes to 'result' (in the same order as 'bktree::find_within') */
+	void find_within(std::vector<match> &result, std::string_view key, MetricType d) const {
+		STATS_QUERY_BEGIN();
+		if (m_n_nodes)
+			_find_within(result, key, detail::signature_of(key), d, 0);
+		STATS_QUERY_END();
+	}
+
+	/*
+	 * Same matches, in the same order, as 'find_within', but the nodes are evaluated a frontier at a time: the distances
+	 * to all the queued nodes are computed in one call (several keys per vector register, if 'Distance' is batched),
+	 * then the children which pass the same pruning as in '_find_within' are queued (the nodes ruled out by their signature
+	 * taking the distance the bounded kernel would give them, 'bound + 1', uncomputed). The children of a node are queued
+	 * together and in edge order, thus the pre-order of the matches is recovered from the visited nodes at the end
+	 */
+	void find_within_frontier(std::vector<match> &result, std::string_view key, MetricType d) const {
+		struct visit {
+			node_id id;
+			MetricType distance;
+			uint32_t first, last;
+		};
+		struct workspace {
+			std::vector<visit> visited;
+			std::vector<std::string_view> keys;
+			std::vector<MetricType> bounds, distances, computed;
+			std::vector<uint32_t> slots, stack;
+		};
+		thread_local workspace local;
+		auto &[visited, keys, bounds, distances, computed, slots, stack] = local;
+		if (!m_n_nodes)
+			return;
+		STATS_QUERY_BEGIN();
+
+		Distance f;
+		const uint64_t signature = detail::signature_of(key);
+		visited.assign(1, visit{0, 0, 0, 0});
+		for (size_t first = 0, last; first != visited.size(); first = last) {
+			last = visited.size();
+			keys.clear();
+			bounds.clear();
+			slots.clear();
+			distances.resize(last - first);
+			for (size_t pos = first; pos != last; ++pos) {
+				const node &current = m_nodes[visited[pos].id];
+				MetricType bound = d + (current.n_children ? m_edges[current.first_child + current.n_children - 1].distance : 0);
+				STATS_COUNT(nodesVisited);
+				if (detail::rules_out(key.size(), signature, current, d, bound)) {
+					STATS_COUNT(signaturesPruned);
+					distances[pos - first] = bound + 1;
+					continue;
+				}
+				STATS_COUNT(distancesComputed);
+				keys.push_back(std::string_view(m_chars + current.offset, current.key_length()));
+				bounds.push_back(bound);
+				slots.push_back(pos - first);
+			}
+			computed.resize(keys.size());
+			if constexpr (detail::is_batched_distance<MetricType, Distance>::value) {
+				f(key, keys.data(), bounds.data(), computed.data(), keys.size());
+			} else {
+				for (size_t i = 0; i != keys.size(); ++i) {
+					if constexpr (detail::is_bounded_distance<std::string_view, MetricType, Distance>::value)
+						computed[i] = f(key, keys[i], bounds[i]);
+					else
+						computed[i] = f(key, keys[i]);
+				}
+			}
+			for (size_t i = 0; i != keys.size(); ++i)
+				distances[slots[i]] = computed[i];
+
+			for (size_t pos = first; pos != last; ++pos) {
+				const node &current = m_nodes[visited[pos].id];
+				const MetricType n = distances[pos - first];
+				visited[pos].distance = n;
+				visited[pos].first = visited.size();
+				for (const edge *e = m_edges + current.first_child, *end = e + current.n_children; e != end; ++e) {
+					if (e->distance + d >= n && e->distance <= n + d)
+						visited.push_back(visit{e->child, 0, 0, 0});
+					else
+						STATS_COUNT(childrenPruned);
+				}
+				visited[pos].last = visited.size();
+			}
+		}
+
+		stack.assign(1, 0);
+		while (!stack.empty()) {
+			const visit &current = visited[stack.back()];
+			stack.pop_back();
+			if (current.distance <= d && !m_nodes[current.id].erased())
+				result.push_back({current.id, current.distance});
+			for (uint32_t child = current.last; child-- != current.first; )
+				stack.push_back(child);
+		}
+		STATS_QUERY_END();
+	}
+
+	std::vector<std::pair<std::string, MetricType>> find_within(std::string_view key, MetricType d) const {
+		std::vector<match> matches;
+		find_within(matches, key, d);
+		std::vector<std::pair<std::string, MetricType>> result;
+		result.reserve(matches.size());
+		for (auto &m : matches)
+			result.emplace_back(std::string(this->key(m.node)), m.distance);
+		return result;
+	}
+
+	std::string_view key(node_id id) const {
+		return std::string_view(m_chars + m_nodes[id].offset, m_nodes[id].key_length());
+	}
+
+	bool erased(node_id id) const {
+		return m_nodes[id].erased();
+	}
+
+	void dump_tree(node_id id = 0, int depth = 0) const {
+		for (int i = 0; i < depth; ++i)
+			std::cout << "    ";
+		std::cout << this->key(id) << (erased(id) ? " (erased)" : "") << std::endl;
+		for (uint32_t i = 0; i != m_nodes[id].n_children; ++i)
+			dump_tree(m_edges[m_nodes[id].first_child + i].child, depth + 1);
+	}
+
+public:
+	size_t size() const {
+		return m_n_nodes;
+	}
+
+	/* the raw arrays, e.g. to serialize the tree */
+	const char *chars() const { return m_chars; }
+	size_t n_chars() const { return m_n_chars; }
+	const node *nodes() const { return m_nodes; }
+	const edge *edges() const { return m_edges; }
+	size_t n_edges() const { return m_n_edges; }
+};
+
+/*
+ * Same semantics as 'bktree<std::string, MetricType, Distance>', but laid out for cache-friendly queries
+ * (see 'flat_bktree_view' for the layout).
+ *
+ * Keys are inserted into a build state (singly-linked child lists); 'compact()' lays the edges out
+ * and has to be called before querying. The range constructor does both.
+ */
+template <
+	typename MetricType,
+	typename Distance
+>
+class flat_bktree
+{
+public:
+	typedef flat_bktree_view<MetricType, Distance> view_type;
+	typedef typename view_type::node_id node_id;
+	typedef typename view_type::match match;
+
+private:
+	typedef typename view_type::node node;
+	typedef typename view_type::edge edge;
+
+	/* edge of the build state, chained through 'next' */
+	struct pending_edge {
+		MetricType distance;
+		node_id child;
+		uint32_t next;
+	};
+
+	static constexpr uint32_t npos = UINT32_MAX;
+
+private:
+	std::vector<char> m_chars;
+	std::vector<node> m_nodes;
+	std::vector<edge> m_edges;
+	std::vector<uint32_t> m_heads;
+	std::vector<pending_edge> m_pending;
+	bool m_compact;
+
+public:
+	flat_bktree() : m_compact(true) { }
+
+	template <typename InputIterator>
+	flat_bktree(InputIterator first, InputIterator last) : m_compact(true) {
+		for (; first != last; ++first)
+			insert(*first);
+		compact();
+	}
+
+	/* a copy of the tree behind 'tree' (e.g. a mapped one), which can be updated */
+	explicit flat_bktree(const view_type &tree)
+		: m_chars(tree.chars(), tree.chars() + tree.n_chars()), m_nodes(tree.nodes(), tree.nodes() + tree.size()),
+		  m_edges(tree.edges(), tree.edges() + tree.n_edges()), m_compact(true) { }
+
+	/*
+	 * Bulk-load the distinct 'keys' on 'thread_count' threads. Key i becomes node i, and the tree is the very one
+	 * inserting the keys in order builds (the child of a node at distance d is the first key of its subtree at distance d),
+	 * thus 'find_within' answers the same. Each node partitions the keys of its subtree by their distance to it,
+	 * with a stable counting sort, and the subtrees are built independently: breadth-first on the calling thread
+	 * until there are enough of them, then in parallel, the largest first
+	 */
+	flat_bktree(const std::vector<std::string_view> &keys, unsigned thread_count) : m_compact(true) {
+		const node_id n_keys = keys.size();
+		if (!n_keys)
+			return;
+		m_nodes.reserve(n_keys);
+		for (auto key : keys) {
+			m_nodes.push_back({static_cast<uint32_t>(m_chars.size()), static_cast<uint32_t>(key.size()), 0, 0, detail::signature_of(key), 0, 0, 0});
+			m_chars.insert(m_chars.end(), key.begin(), key.end());
+		}
+
+		/* the keys below a node are a range of 'ids', which its build partitions in place (through 'scratch') */
+		std::vector<node_id> ids(n_keys - 1), scratch(n_keys - 1);
+		std::vector<MetricType> distances(n_keys - 1);
+		for (node_id id = 1; id != n_keys; ++id)
+			ids[id - 1] = id;
+		std::vector<std::vector<edge>> children(n_keys);
+
+		struct subtree {
+			node_id root;
+			size_t first, last;
+		};
+		/* partition the keys of 'task' by their distance to its root, and hand out the subtrees of its children */
+		auto partition = [&](const subtree &task, auto &&child_task) {
+			Distance f;
+			MetricType max_distance = 0;
+			for (size_t pos = task.first; pos != task.last; ++pos) {
+				distances[pos] = f(key(task.root), key(ids[pos]));
+				assert(distances[pos]);
+				max_distance = std::max(max_distance, distances[pos]);
+			}
+			std::vector<size_t> starts(static_cast<size_t>(max_distance) + 2, 0);
+			for (size_t pos = task.first; pos != task.last; ++pos)
+				starts[distances[pos] + 1]++;
+			for (size_t d = 1; d != starts.size(); ++d)
+				starts[d] += starts[d - 1];
+			std::vector<size_t> fill(starts.begin(), starts.end() - 1);
+			for (size_t pos = task.first; pos != task.last; ++pos)
+				scratch[task.first + fill[distances[pos]]++] = ids[pos];
+			std::copy(scratch.begin() + task.first, scratch.begin() + task.last, ids.begin() + task.first);
+			for (size_t d = 0; d + 1 != starts.size(); ++d) {
+				if (starts[d] == starts[d + 1])
+					continue;
+				size_t first = task.first + starts[d], last = task.first + starts[d + 1];
+				children[task.root].push_back({static_cast<MetricType>(d), ids[first]});
+				child_task(subtree{ids[first], first + 1, last});
+			}
+		};
+		auto build = [&partition](const subtree &task) {
+			std::vector<subtree> stack(1, task);
+			while (!stack.empty()) {
+				subtree current = stack.back();
+				stack.pop_back();
+				partition(current, [&stack](const subtree &child) { if (child.first != child.last) stack.push_back(child); });
+			}
+		};
+
+		std::vector<subtree> frontier(1, subtree{0, 0, ids.size()});
+		if (thread_count > 1) {
+			size_t done = 0;
+			for (; done != frontier.size() && frontier.size() - done < 8 * size_t(thread_count); ++done) {
+				subtree task = frontier[done];
+				partition(task, [&frontier](const subtree &child) { if (child.first != child.last) frontier.push_back(child); });
+			}
+			std::vector<subtree> left(frontier.begin() + done, frontier.end());
+			std::sort(left.begin(), left.end(), [](const subtree &a, const subtree &b) { return a.last - a.first > b.last - b.first; });
+			std::atomic<size_t> next(0);
+			std::vector<std::thread> workers;
+			for (unsigned worker = 0; worker != thread_count; ++worker)
+				workers.emplace_back([&]() {
+					for (size_t pos; (pos = next++) < left.size(); )
+						build(left[pos]);
+				});
+			for (auto &worker : workers)
+				worker.join();
+		} else if (!ids.empty()) {
+			build(frontier.front());
+		}
+
+		/* lay the children out as in 'compact' (they are found in increasing distance) */
+		m_edges.reserve(n_keys - 1);
+		for (node_id id = 0; id != n_keys; ++id) {
+			m_nodes[id].first_child = m_edges.size();
+			m_nodes[id].n_children = children[id].size();
+			m_edges.insert(m_edges.end(), children[id].begin(), children[id].end());
+		}
+		summarize();
+	}
+
+private:
+	MetricType distance_to(std::string_view key, node_id id) const {
+		Distance f;
+		return f(key, this->key(id));
+	}
+
+	/* the child of 'id' at 'distance', 'npos' if none (in either state) */
+	node_id child_at(node_id id, MetricType distance) const {
+		if (m_compact) {
+			const edge *first = m_edges.data() + m_nodes[id].first_child, *last = first + m_nodes[id].n_children;
+			first = std::lower_bound(first, last, distance, [](const edge &e, MetricType d) { return e.distance < d; });
+			return (first != last && first->distance == distance) ? first->child : npos;
+		}
+		for (uint32_t e = m_heads[id]; e != npos; e = m_pending[e].next)
+			if (m_pending[e].distance == distance)
+				return m_pending[e].child;
+		return npos;
+	}
+
+	/* turn the compact edges back into the build state, so that inserting can go on */
+	void expand() {
+		m_heads.assign(m_nodes.size(), npos);
+		m_pending.clear();
+		m_pending.reserve(m_edges.size());
+		for (node_id id = 0; id != m_nodes.size(); ++id) {
+			const node &n = m_nodes[id];
+			for (uint32_t i = n.n_children; i--; ) {
+				const edge &e = m_edges[n.first_child + i];
+				m_pending.push_back({e.distance, e.child, m_heads[id]});
+				m_heads[id] = m_pending.size() - 1;
+			}
+		}
+		m_edges.clear();
+		m_compact = false;
+	}
+
+public:
+	bool insert(std::string_view key) {
+		if (m_compact && !m_nodes.empty())
+			expand();
+		m_compact = false;
+
+		node_id id = m_nodes.size();
+		if (!m_nodes.empty()) {
+			node_id current = 0;
+			for (;;) {
+				MetricType distance = distance_to(key, current);
+				if (distance == 0) {
+					if (!m_nodes[current].erased())
+						return false; /* value already exists */
+					m_nodes[current].length &= ~node::erased_bit; /* revive the erased value, which keeps its node id */
+					return true;
+				}
+
+				uint32_t e = m_heads[current];
+				while (e != npos && m_pending[e].distance != distance)
+					e = m_pending[e].next;
+				if (e == npos) {
+					m_pending.push_back({distance, id, m_heads[current]});
+					m_heads[current] = m_pending.size() - 1;
+					break;
+				}
+				current = m_pending[e].child;
+			}
+		}
+
+		m_nodes.push_back({static_cast<uint32_t>(m_chars.size()), static_cast<uint32_t>(key.size()), 0, 0, detail::signature_of(key), 0, 0, 0});
+		m_heads.push_back(npos);
+		m_chars.insert(m_chars.end(), key.begin(), key.end());
+		return true;
+	}
+
+	/*
+	 * Erase 'key' by leaving a tombstone: the node stays in place to route the searches through it
+	 * (thus the node ids do not change), and inserting the key again revives it
+	 */
+	bool erase(std::string_view key) {
+		if (m_nodes.empty())
+			return false;
+		node_id current = 0;
+		for (;;) {
+			MetricType distance = distance_to(key, current);
+			if (distance == 0)
+				break;
+			current = child_at(current, distance);
+			if (current == npos)
+				return false;
+		}
+		if (m_nodes[current].erased())
+			return false;
+		m_nodes[current].length |= node::erased_bit;
+		return true;
+	}
+
+	/* lay out the children of each node as a sorted run in the edge array and drop the build state */
+	void compact() {
+		if (m_compact)
+			return;
+		m_edges.clear();
+		m_edges.reserve(m_pending.size());
+		for (node_id id = 0; id != m_nodes.size(); ++id) {
+			node &n = m_nodes[id];
+			n.first_child = m_edges.size();
+			for (uint32_t e = m_heads[id]; e != npos; e = m_pending[e].next)
+				m_edges.push_back({m_pending[e].distance, m_pending[e].child});
+			n.n_children = m_edges.size() - n.first_child;
+			std::sort(m_edges.begin() + n.first_child, m_edges.end(),
+				[](const edge &a, const edge &b) { return a.distance < b.distance; });
+		}
+		std::vector<uint32_t>().swap(m_heads);
+		std::vector<pending_edge>().swap(m_pending);
+		m_chars.shrink_to_fit();
+		m_nodes.shrink_to_fit();
+		m_compact = true;
+		summarize();
+	}
+
+private:
+	/* fill in the signatures of the subtrees, children before parents (the node ids need not follow the depth, e.g. bulk-loaded) */
+	void summarize() {
+		if (m_nodes.empty())
+			return;
+		std::vector<std::pair<node_id, bool>> stack(1, {0, false});
+		while (!stack.empty()) {
+			auto [id, expanded] = stack.back();
+			node &n = m_nodes[id];
+			if (!expanded) {
+				stack.back().second = true;
+				for (uint32_t e = 0; e != n.n_children; ++e)
+					stack.push_back({m_edges[n.first_child + e].child, false});
+				continue;
+			}
+			stack.pop_back();
+			n.subtree_signature = n.signature;
+			n.min_length = n.max_length = n.key_length();
+			for (uint32_t e = 0; e != n.n_children; ++e) {
+				const node &child = m_nodes[m_edges[n.first_child + e].child];
+				n.subtree_signature |= child.subtree_signature;
+				n.min_length = std::min(n.min_length, child.min_length);
+				n.max_length = std::max(n.max_length, child.max_length);
+			}
+		}
+	}
+
+public:
+	view_type view() const {
+		assert(m_compact);
+		return view_type(m_chars.data(), m_chars.size(), m_nodes.data(), m_nodes.size(), m_edges.data(), m_edges.size());
+	}
+
+	void find_within(std::vector<match> &result, std::string_view key, MetricType d) const {
+		view().find_within(result, key, d);
+	}
+
+	std::vector<std::pair<std::string, MetricType>> find_within(std::string_view key, MetricType d) const {
+		return view().find_within(key, d);
+	}
+
+	std::string_view key(node_id id) const {
+		return std::string_view(m_chars.data() + m_nodes[id].offset, m_nodes[id].key_length());
+	}
+
+	bool erased(node_id id) const {
+		return m_nodes[id].erased();
+	}
+
+	void dump_tree() const {
+		view().dump_tree();
+	}
+
+public:
+	size_t size() const {
+		return m_nodes.size();
+	}
+};
+
+} /* namespace storage */
+
+#endif /* _FLAT_BK_TREE_HPP_ */
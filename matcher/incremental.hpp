@@ -0,0 +1,280 @@
+#ifndef _INCREMENTAL_HPP_
+#define _INCREMENTAL_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+#include "matcher.hpp"
+
+// Incremental re-matching, for the refreshes of the lists in which only a few entries change:
+// - the index is updated in place of being rebuilt: the new German words are inserted into the tree of the previous snapshot,
+//   the vanished ones are erased (as tombstones), and the words whose posting lists changed are collected,
+// - the matching of each row of the database file is kept in a state file, under the fingerprint of the row along with
+//   the words the matcher looked up for it, so that only the new rows and the rows which looked up a word
+//   within SEARCH_PRECISION of a changed word are matched again.
+
+// What changed in the index since the previous snapshot
+struct indexChanges {
+  // The fingerprint of the list the previous snapshot had been built from (0 if there was none)
+  uint64_t previousHash = 0;
+  // The words whose posting lists changed: added, erased or of other medicines
+  VS words;
+  // The row of each medicine of the previous snapshot in the current one, 'medSnapshot::npos' if removed
+  VI rowMap;
+  // Whether the medicines kept their relative order (otherwise ties between rows could be broken differently)
+  bool ordered = true;
+};
+
+// Update the snapshot 'previous' to the current list of medicines in 'language', into 'index'.
+// The word ids of 'previous' are kept, thus the new words are appended to its tree
+inline void updateIndex(const std::string& language, uint64_t sourceHash, const medSnapshot& previous, medSnapshot& index, indexChanges& changes,
+                        postingFormat format = postingFormat::plain) {
+  const auto& previousTree = previous.tree();
+  const uint32_t previousCount = previousTree.size();
+
+  // Split up the current medicines, on top of the previous vocabulary
+  stringPool words;
+  postingStore postings;
+  medicineIndex medIndex;
+  {
+    STATS_PHASE(dissolveMeds);
+    for (uint32_t word = 0; word != previousCount; ++word)
+      words.intern(previousTree.key(word));
+    dissolveMeds(language, words, postings, medIndex);
+  }
+
+  // Find the previous medicines among the current ones (the unique id at the end of each name tells them apart)
+  stringPool names;
+  for (auto& name : medIndex)
+    names.intern(name);
+  changes.previousHash = previous.sourceHash();
+  changes.ordered = (names.size() == medIndex.size());
+  changes.rowMap.assign(previous.medicineCount(), medSnapshot::npos);
+  for (uint32_t row = 0, last = 0; row != previous.medicineCount(); ++row) {
+    auto current = names.find(previous.medicine(row));
+    if (current == stringPool::npos)
+      continue;
+    changes.rowMap[row] = current;
+    if ((last) && (current < last))
+      changes.ordered = false;
+    last = current + 1;
+  }
+
+  // Collect the changed words, and update the tree accordingly
+  metricTree container(previousTree);
+  {
+    STATS_PHASE(buildStorage);
+    changes.words.clear();
+    for (uint32_t word = 0; word != words.size(); ++word) {
+      auto current = postings[word];
+      if (word >= previousCount) {
+        bool inserted = container.insert(words.at(word));
+        assert(inserted);
+        (void)inserted;
+        changes.words.emplace_back(words.at(word));
+        continue;
+      }
+
+      // Compare the previous rows, mapped to the current ones
+      const uint32_t* pos = current.begin();
+      bool same = true;
+      for (auto row : previous.postings(word)) {
+        if ((pos == current.end()) || (changes.rowMap[row] != *pos)) {
+          same = false;
+          break;
+        }
+        ++pos;
+      }
+      if ((same) && (pos == current.end()))
+        continue;
+      changes.words.emplace_back(words.at(word));
+      if (!current.size())
+        container.erase(words.at(word));
+      else if (previousTree.erased(word))
+        container.insert(words.at(word));
+    }
+    container.compact();
+  }
+
+  STATS_PHASE(buildSnapshot);
+  index.build(container.view(), postings, medIndex, medIndex.size(), sourceHash, MIN_LEN, format);
+}
+
+// Like 'loadIndex', but update the snapshot in 'indexFileName' if stale (rather than rebuilding it), and report what changed
+inline void loadIndexIncrementally(const std::string& language, const std::string& indexFileName, medSnapshot& index, indexChanges& changes,
+                                   postingFormat format = postingFormat::plain) {
+  uint64_t sourceHash = hashFile(medsFileName(language));
+  {
+    STATS_PHASE(openSnapshot);
+    if (index.open(indexFileName, sourceHash, MIN_LEN, format)) {
+      changes.previousHash = sourceHash;
+      changes.rowMap.resize(index.medicineCount());
+      std::iota(changes.rowMap.begin(), changes.rowMap.end(), 0);
+      return;
+    }
+  }
+
+  medSnapshot previous;
+  if ((previous.open(indexFileName)) && (previous.minLen() == MIN_LEN)) {
+    updateIndex(language, sourceHash, previous, index, changes, format);
+  } else {
+    changes = indexChanges();
+    buildIndex(language, sourceHash, index, format);
+  }
+  if (!index.save(indexFileName))
+    std::cerr << "index \"" << indexFileName << "\" could not be written" << std::endl;
+}
+
+// The matching of a row of the database file
+struct rowMatching {
+  uint64_t fingerprint;
+  VI rows;
+  // The words looked up for the row
+  VS probes;
+};
+
+// The matching of the rows of the database file, against the snapshot built from the list with fingerprint 'indexHash'.
+// Saved as text: a header line, then a line per distinct row "<fingerprint> <#rows> <rows>.. <#probes> <probes>.."
+class matchState {
+  static constexpr const char* magic = "LANGSOME-STATE";
+  static constexpr uint32_t version = 1;
+
+  public:
+  uint64_t indexHash = 0;
+  // Sorted by fingerprint
+  std::vector<rowMatching> entries;
+
+  bool load(const std::string& fileName) {
+    entries.clear();
+    std::ifstream input(fileName);
+    std::string tag;
+    uint32_t fileVersion, minLen, precision;
+    if ((!(input >> tag >> fileVersion >> minLen >> precision >> indexHash)) || (tag != magic) || (fileVersion != version)
+        || (minLen != MIN_LEN) || (precision != SEARCH_PRECISION)) {
+      indexHash = 0;
+      return false;
+    }
+    for (rowMatching entry; input >> entry.fingerprint; ) {
+      size_t count;
+      input >> count;
+      entry.rows.resize(count);
+      for (auto& row : entry.rows)
+        input >> row;
+      input >> count;
+      entry.probes.resize(count);
+      for (auto& probe : entry.probes)
+        input >> probe;
+      if (!input) {
+        indexHash = 0;
+        entries.clear();
+        return false;
+      }
+      entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const rowMatching& a, const rowMatching& b) { return a.fingerprint < b.fingerprint; });
+    return true;
+  }
+
+  bool save(const std::string& fileName) const {
+    // Unique to the process, as for the snapshots: two runs may update the same state file at once
+    std::string tempFileName = fileName + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream output(tempFileName, std::ios::trunc);
+      output << magic << " " << version << " " << MIN_LEN << " " << SEARCH_PRECISION << " " << indexHash << "\n";
+      for (auto& entry : entries) {
+        output << entry.fingerprint << " " << entry.rows.size();
+        for (auto row : entry.rows)
+          output << " " << row;
+        output << " " << entry.probes.size();
+        for (auto& probe : entry.probes)
+          output << " " << probe;
+        output << "\n";
+      }
+      if (!output) {
+        output.close();
+        remove(tempFileName.c_str());
+        return false;
+      }
+    }
+    if (rename(tempFileName.c_str(), fileName.c_str())) {
+      remove(tempFileName.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  const rowMatching* find(uint64_t fingerprint) const {
+    auto pos = std::lower_bound(entries.begin(), entries.end(), fingerprint,
+                                [](const rowMatching& entry, uint64_t value) { return entry.fingerprint < value; });
+    return ((pos != entries.end()) && (pos->fingerprint == fingerprint)) ? &*pos : nullptr;
+  }
+};
+
+// Match 'rows' into 'matched' (the German rows of each row), reusing the matching in 'previous' of the rows unaffected by 'changes'.
+// 'current' receives the matching of all rows. Returns the number of rows matched again
+inline uint32_t matchIncrementally(Matcher& matcher, const std::vector<drugbankRecord>& rows, const matchState& previous, const indexChanges& changes,
+                                   matchState& current, std::vector<VI>& matched) {
+  // The previous matching is only of use if it was done against the previous snapshot, whose rows kept their order
+  bool reusable = (previous.indexHash) && (previous.indexHash == changes.previousHash) && (changes.ordered);
+
+  // A row is affected if one of its lookups is within SEARCH_PRECISION of a changed word
+  metricTree changedTree(changes.words.begin(), changes.words.end());
+  deletionIndex changed(changedTree.view(), SEARCH_PRECISION);
+  treeMatches devs;
+  auto affected = [&changed, &devs](const rowMatching& entry) -> bool {
+    for (auto& probe : entry.probes) {
+      devs.clear();
+      changed.find_within(devs, probe, SEARCH_PRECISION);
+      if (!devs.empty())
+        return true;
+    }
+    return false;
+  };
+
+  uint32_t rematched = 0;
+  VS probes;
+  scoredRows scored;
+  current.indexHash = matcher.medicines().sourceHash();
+  current.entries.clear();
+  matched.assign(rows.size(), VI());
+  for (size_t pos = 0; pos != rows.size(); ++pos) {
+    rowMatching entry;
+    entry.fingerprint = fnv1a(rows[pos].record.data(), rows[pos].record.size());
+    auto known = reusable ? previous.find(entry.fingerprint) : nullptr;
+    if ((known) && (!affected(*known))) {
+      entry.probes = known->probes;
+      for (auto row : known->rows)
+        entry.rows.push_back(changes.rowMap[row]);
+    } else {
+      ++rematched;
+      probes.clear();
+      scored.clear();
+      matcher.recordProbes(&probes);
+      matcher.matchRow(parseRecord(rows[pos]), scored);
+      matcher.recordProbes(nullptr);
+      for (auto [row, closeness] : scored)
+        entry.rows.push_back(row);
+
+      // Names with whitespaces can not be in the vocabulary (and are only looked up exactly)
+      for (auto& probe : probes)
+        if (std::none_of(probe.begin(), probe.end(), [](char c) { return isspace(static_cast<uint8_t>(c)); }))
+          entry.probes.push_back(probe);
+      std::sort(entry.probes.begin(), entry.probes.end());
+      entry.probes.erase(std::unique(entry.probes.begin(), entry.probes.end()), entry.probes.end());
+    }
+    matched[pos] = entry.rows;
+    current.entries.push_back(std::move(entry));
+  }
+
+  // Equal rows share an entry
+  std::sort(current.entries.begin(), current.entries.end(), [](const rowMatching& a, const rowMatching& b) { return a.fingerprint < b.fingerprint; });
+  current.entries.erase(std::unique(current.entries.begin(), current.entries.end(),
+                                    [](const rowMatching& a, const rowMatching& b) { return a.fingerprint == b.fingerprint; }), current.entries.end());
+  return rematched;
+}
+
+#endif /* _INCREMENTAL_HPP_ */
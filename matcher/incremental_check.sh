@@ -0,0 +1,33 @@
+#!/bin/sh
+# The incremental matching against a full run, on a tiny corpus: after the German list changes, the output of '--incremental'
+# has to be the output of a run from scratch, with each fuzzy index. The removed word "abcdefg" is queried itself,
+# thus its tombstone (distance 0) has to route the search to its children in the BK-Tree.
+# Example: ./incremental_check.sh ./match
+
+MATCH=$(cd "$(dirname "${1:-./match}")" && pwd)/$(basename "${1:-./match}")
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+mkdir "$DIR/meds" "$DIR/run"
+cd "$DIR/run" || exit 1
+
+printf 'Abcdefg\nTabletten\nAbcdefx,Abcdefy\n' > ../meds/en_meds.csv
+failed=0
+for fuzzy in bktree frontier deletion join; do
+  rm -f state state.index graph.matched
+  printf 'Abcdefg-Tabletten_1\nAbcdefx-Tabletten_2\nAbcdefz-Kapseln_3\n' > ../meds/de_meds.csv
+  "$MATCH" ../meds/en_meds.csv --meds ../meds --fuzzy $fuzzy --incremental state > /dev/null 2>&1 || exit 1
+
+  # Remove the first row, and add one
+  printf 'Abcdefx-Tabletten_2\nAbcdefz-Kapseln_3\nAbcdefw-Saft_4\n' > ../meds/de_meds.csv
+  "$MATCH" ../meds/en_meds.csv --meds ../meds --fuzzy $fuzzy --incremental state > /dev/null 2>&1 || exit 1
+  mv graph.matched incremental.matched
+  "$MATCH" ../meds/en_meds.csv --meds ../meds --fuzzy $fuzzy > /dev/null 2>&1 || exit 1
+  if cmp -s incremental.matched graph.matched; then
+    echo "--fuzzy $fuzzy: same output"
+  else
+    echo "--fuzzy $fuzzy: the incremental output differs from a full run"
+    diff incremental.matched graph.matched
+    failed=1
+  fi
+done
+exit $failed
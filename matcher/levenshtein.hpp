@@ -0,0 +1,409 @@
+#ifndef _LEVENSHTEIN_HPP_
+#define _LEVENSHTEIN_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// The distance kernels which can be plugged in as 'Distance' into 'storage::bktree'.
+// Besides the usual 'operator()(source, target)', a kernel may provide 'operator()(source, target, bound)',
+// which is allowed to return 'bound + 1' as soon as the distance is known to exceed 'bound'.
+
+struct levenshteinDistance {
+  private:
+  // Efficient implementation of Levenshtein Distance
+  uint32_t impl(std::string_view source, std::string_view target) {
+    if (source.size() > target.size())
+      return impl(target, source);
+
+    const unsigned min_size = source.size(), max_size = target.size();
+    std::vector<unsigned> levDist(min_size + 1);
+
+    levDist[0] = 0;
+    for (unsigned i = 1; i <= min_size; ++i)
+      levDist[i] = i;
+
+    for (unsigned j = 1; j <= max_size; ++j) {
+      unsigned previous_diagonal = levDist[0], previous_diagonal_save;
+      levDist[0] += 1;
+
+      for (unsigned i = 1; i <= min_size; ++i) {
+        previous_diagonal_save = levDist[i];
+
+        if (source[i - 1] == target[j - 1]) {
+          levDist[i] = previous_diagonal;
+        } else {
+          levDist[i] = std::min(std::min(levDist[i - 1] + 1, levDist[i] + 1), previous_diagonal + 1);
+        }
+        previous_diagonal = previous_diagonal_save;
+      }
+    }
+    return levDist[min_size];
+  }
+
+  public:
+  uint32_t operator()(std::string_view source, std::string_view target) {
+    return impl(source, target);
+  }
+};
+
+// Bit-parallel Levenshtein distance (Myers' algorithm, in the formulation of Hyyrö for the global distance).
+// The shorter string is encoded as bit-vectors, one column of the DP matrix being computed with a handful of word operations.
+// Words of at most 64 chars fit into a single machine word, longer ones fall back to the blocked variant.
+struct bitParallelLevenshtein {
+  private:
+  static constexpr unsigned wordSize = 64;
+
+  // The match masks of the pattern, indexed by character. The tables are always kept zeroed between calls,
+  // so that only the entries of the pattern need to be set and reset again (no allocation, no full clearing)
+  static uint64_t* singleTable() {
+    thread_local uint64_t peq[256] = {};
+    return peq;
+  }
+
+  // Compute the distance, where 'pattern' is the shorter string and has at most 64 chars
+  static uint32_t single(std::string_view pattern, std::string_view text, uint32_t bound) {
+    const unsigned m = pattern.size(), n = text.size();
+    uint64_t* peq = singleTable();
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(pattern[i])] |= uint64_t(1) << i;
+
+    const uint64_t last = uint64_t(1) << (m - 1);
+    uint64_t pv = ~uint64_t(0), mv = 0;
+    uint32_t score = m;
+    for (unsigned j = 0; j != n; ++j) {
+      const uint64_t eq = peq[static_cast<uint8_t>(text[j])];
+      const uint64_t xv = eq | mv;
+      const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      uint64_t ph = mv | ~(xh | pv);
+      uint64_t mh = pv & xh;
+      if (ph & last)
+        ++score;
+      else if (mh & last)
+        --score;
+
+      // The score can decrease by at most one per remaining column
+      if (score > bound + (n - j - 1)) {
+        score = bound + 1;
+        break;
+      }
+
+      ph = (ph << 1) | 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
+
+    // Reset the table for the next call
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(pattern[i])] = 0;
+    return score;
+  }
+
+  // Compute the distance for patterns longer than 64 chars, by chaining the words of the bit-vectors
+  static uint32_t blocked(std::string_view pattern, std::string_view text, uint32_t bound) {
+    const unsigned m = pattern.size(), n = text.size(), blocks = (m + wordSize - 1) / wordSize;
+
+    // The buffers only grow, thus long words do not allocate once the largest one has been seen
+    thread_local std::vector<uint64_t> peq, pvs, mvs;
+    if (peq.size() < 256 * blocks)
+      peq.resize(256 * blocks, 0);
+    pvs.assign(blocks, ~uint64_t(0));
+    mvs.assign(blocks, 0);
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(pattern[i]) * blocks + i / wordSize] |= uint64_t(1) << (i % wordSize);
+
+    const unsigned lastBit = (m - 1) % wordSize;
+    uint32_t score = m;
+    for (unsigned j = 0; j != n; ++j) {
+      const uint64_t* eqs = peq.data() + static_cast<uint8_t>(text[j]) * blocks;
+
+      // The first row of the DP matrix always increases by one
+      int carry = 1;
+      for (unsigned b = 0; b != blocks; ++b) {
+        uint64_t eq = eqs[b], pv = pvs[b], mv = mvs[b];
+        const uint64_t xv = eq | mv;
+        if (carry < 0)
+          eq |= 1;
+        const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+
+        // The horizontal delta at the bottom of the block is carried into the next one
+        const unsigned high = (b + 1 == blocks) ? lastBit : (wordSize - 1);
+        int out = ((ph >> high) & 1) ? 1 : (((mh >> high) & 1) ? -1 : 0);
+
+        ph <<= 1;
+        mh <<= 1;
+        if (carry < 0)
+          mh |= 1;
+        else if (carry > 0)
+          ph |= 1;
+        pvs[b] = mh | ~(xv | ph);
+        mvs[b] = ph & xv;
+        carry = out;
+      }
+      score += carry;
+
+      if (score > bound + (n - j - 1)) {
+        score = bound + 1;
+        break;
+      }
+    }
+
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(pattern[i]) * blocks + i / wordSize] = 0;
+    return score;
+  }
+
+  // The number of columns packed at a time into the lanes: most texts of a batch exceed their bound within a few columns
+  static constexpr unsigned blockColumns = 4;
+
+  // The state of the lanes between two blocks of columns, one entry per lane. 'columns' is the number of columns of its text done so far,
+  // 'limits' the largest score it can have before its last column without exceeding its bound ('bound + length - 1'), 'exceeded' is all ones once it did
+  template <typename T>
+  struct laneState {
+    alignas(32) T pv[32 / sizeof(T)], mv[32 / sizeof(T)], score[32 / sizeof(T)], exceeded[32 / sizeof(T)];
+    alignas(32) T columns[32 / sizeof(T)], lengths[32 / sizeof(T)], limits[32 / sizeof(T)];
+  };
+
+  // The lanes of the batched variant: each lane runs 'single' on its own text, all of them against the same pattern,
+  // on the next 'block' columns of the texts, whose match masks are in 'columns' (column-major, ignored past the end of a text).
+  // Returns the mask of the lanes which are done or over their bound, and stops early once all are.
+  // Generic vectors, thus each target below compiles it for its own registers
+  template <typename T, unsigned Bytes>
+  __attribute__((always_inline)) static inline uint32_t lanes(unsigned m, const T* columns, unsigned block, laneState<T>& state) {
+    typedef T vector __attribute__((vector_size(Bytes)));
+    constexpr unsigned count = Bytes / sizeof(T);
+    vector pv, mv, score, exceeded, j, lens, lims, finished = vector{};
+    memcpy(&pv, state.pv, Bytes);
+    memcpy(&mv, state.mv, Bytes);
+    memcpy(&score, state.score, Bytes);
+    memcpy(&exceeded, state.exceeded, Bytes);
+    memcpy(&j, state.columns, Bytes);
+    memcpy(&lens, state.lengths, Bytes);
+    memcpy(&lims, state.limits, Bytes);
+
+    const T last = T(1) << (m - 1);
+    for (unsigned column = 0; column != block; ++column) {
+      vector eq;
+      memcpy(&eq, columns + column * count, Bytes);
+      const vector xv = eq | mv;
+      const vector xh = (((eq & pv) + pv) ^ pv) | eq;
+      vector ph = mv | ~(xh | pv);
+      vector mh = pv & xh;
+
+      // The masks are all ones where set: the lanes past the end of their text keep their score
+      const vector active = (vector)(lens > j);
+      score -= (vector)((ph & last) != 0) & active;
+      score += (vector)((mh & last) != 0) & active;
+      exceeded |= (vector)(score + j > lims) & active;
+      j += 1;
+
+      ph = (ph << 1) | 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+
+      finished = exceeded | (vector)(lens <= j);
+      uint64_t words[Bytes / 8];
+      memcpy(words, &finished, Bytes);
+      if (std::all_of(words, words + Bytes / 8, [](uint64_t word) { return word == ~uint64_t(0); }))
+        break;
+    }
+    memcpy(state.pv, &pv, Bytes);
+    memcpy(state.mv, &mv, Bytes);
+    memcpy(state.score, &score, Bytes);
+    memcpy(state.exceeded, &exceeded, Bytes);
+    memcpy(state.columns, &j, Bytes);
+
+    uint32_t mask = 0;
+    for (unsigned lane = 0; lane != count; ++lane)
+      mask |= uint32_t(finished[lane] & 1) << lane;
+    return mask;
+  }
+
+  // The lane widths for the patterns of at most 16, 32 and 64 chars, on vectors of 'bytes' bytes
+  struct laneKernels {
+    unsigned bytes;
+    uint32_t (*run16)(unsigned, const uint16_t*, unsigned, laneState<uint16_t>&);
+    uint32_t (*run32)(unsigned, const uint32_t*, unsigned, laneState<uint32_t>&);
+    uint32_t (*run64)(unsigned, const uint64_t*, unsigned, laneState<uint64_t>&);
+
+    template <typename T>
+    auto run() const {
+      if constexpr (sizeof(T) == 2)
+        return run16;
+      else if constexpr (sizeof(T) == 4)
+        return run32;
+      else
+        return run64;
+    }
+  };
+
+  template <typename T, unsigned Bytes>
+  static uint32_t genericLanes(unsigned m, const T* columns, unsigned block, laneState<T>& state) {
+    return lanes<T, Bytes>(m, columns, block, state);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  template <typename T>
+  __attribute__((target("avx2"))) static uint32_t avx2Lanes(unsigned m, const T* columns, unsigned block, laneState<T>& state) {
+    return lanes<T, 32>(m, columns, block, state);
+  }
+
+  template <typename T>
+  __attribute__((target("sse4.2"))) static uint32_t sseLanes(unsigned m, const T* columns, unsigned block, laneState<T>& state) {
+    return lanes<T, 16>(m, columns, block, state);
+  }
+#endif
+
+  // Picked once, on the first batch: AVX2 (16 lanes for the short patterns), else SSE 4.2, else the baseline instructions
+  static const laneKernels& kernels() {
+    static const laneKernels picked = []() -> laneKernels {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2"))
+        return {32, avx2Lanes<uint16_t>, avx2Lanes<uint32_t>, avx2Lanes<uint64_t>};
+      if (__builtin_cpu_supports("sse4.2"))
+        return {16, sseLanes<uint16_t>, sseLanes<uint32_t>, sseLanes<uint64_t>};
+#endif
+      return {16, genericLanes<uint16_t, 16>, genericLanes<uint32_t, 16>, genericLanes<uint64_t, 16>};
+    }();
+    return picked;
+  }
+
+  // The batched distances for a pattern of at most 'sizeof(T) * 8' chars, whose match masks are in 'peq'.
+  // The texts which cannot qualify by their length are settled first, the others are fed to the lanes a block of columns at a time:
+  // a lane takes the next text as soon as its own is done, thus the lanes do not wait for the longest text of the batch.
+  // The texts too long for the width of the lanes are left to the caller, in 'deferred'
+  template <typename T>
+  static void lanesBatch(const uint64_t* peq, unsigned m, const std::string_view* texts, const uint32_t* bounds, uint32_t* distances,
+                         size_t count, std::vector<uint32_t>& deferred) {
+    constexpr unsigned maxWidth = 32 / sizeof(T);
+    const laneKernels& kernel = kernels();
+    const unsigned width = kernel.bytes / sizeof(T);
+    thread_local std::vector<uint32_t> pending;
+    alignas(32) T columns[blockColumns * maxWidth];
+    laneState<T> state;
+    const char* chars[maxWidth];
+    uint32_t text[maxWidth];
+
+    pending.resize(count);
+    size_t pendingCount = 0;
+    for (size_t i = 0; i != count; ++i) {
+      const unsigned n = texts[i].size(), bound = bounds[i];
+      const bool qualifies = (n > m ? n - m : m - n) <= bound;
+      distances[i] = qualifies ? n + m : bound + 1;
+      if (qualifies && (!n || uint64_t(bound) + 2 * n + m >= std::numeric_limits<T>::max())) {
+        if (n)
+          deferred.push_back(i);
+        continue;
+      }
+      pending[pendingCount] = i;
+      pendingCount += qualifies;
+    }
+
+    // Start a lane on the next pending text, or leave it idle (no columns, thus always done)
+    size_t next = 0;
+    auto start = [&](unsigned lane) {
+      state.pv[lane] = ~T(0);
+      state.mv[lane] = 0;
+      state.score[lane] = m;
+      state.exceeded[lane] = 0;
+      state.columns[lane] = 0;
+      if (next == pendingCount) {
+        text[lane] = UINT32_MAX;
+        chars[lane] = "";
+        state.lengths[lane] = 0;
+        state.limits[lane] = 0;
+        return;
+      }
+      const uint32_t i = pending[next++];
+      text[lane] = i;
+      chars[lane] = texts[i].data();
+      state.lengths[lane] = texts[i].size();
+      state.limits[lane] = bounds[i] + texts[i].size() - 1;
+    };
+    for (unsigned lane = 0; lane != width; ++lane)
+      start(lane);
+
+    for (unsigned busy = std::min<size_t>(width, pendingCount); busy; ) {
+      // Past the end of its text, a lane reads its last char again (the lane is masked out there)
+      for (unsigned lane = 0; lane != width; ++lane) {
+        const unsigned j = state.columns[lane], end = state.lengths[lane] ? state.lengths[lane] - 1 : 0;
+        for (unsigned column = 0; column != blockColumns; ++column)
+          columns[column * width + lane] = peq[static_cast<uint8_t>(chars[lane][std::min(j + column, end)])];
+      }
+      for (uint32_t done = kernel.template run<T>()(m, columns, blockColumns, state); done; done &= done - 1) {
+        const unsigned lane = __builtin_ctz(done);
+        if (text[lane] == UINT32_MAX)
+          continue;
+        distances[text[lane]] = std::min<uint64_t>(state.score[lane] | state.exceeded[lane], uint64_t(bounds[text[lane]]) + 1);
+        start(lane);
+        busy -= text[lane] == UINT32_MAX;
+      }
+    }
+  }
+
+  static uint32_t impl(std::string_view source, std::string_view target, uint32_t bound) {
+    if (source.size() > target.size())
+      return impl(target, source, bound);
+
+    // The distance is at least the difference of the lengths
+    if (target.size() - source.size() > bound)
+      return bound + 1;
+    if (source.empty())
+      return target.size();
+    if (source.size() <= wordSize)
+      return single(source, target, bound);
+    return blocked(source, target, bound);
+  }
+
+  public:
+  uint32_t operator()(std::string_view source, std::string_view target) {
+    // The distance never exceeds the length of the longer string, so the bound is never hit
+    return impl(source, target, std::max(source.size(), target.size()));
+  }
+
+  // Bounded variant: stops as soon as the distance provably exceeds 'bound' and returns 'bound + 1' in that case
+  uint32_t operator()(std::string_view source, std::string_view target, uint32_t bound) {
+    return std::min(impl(source, target, bound), bound + 1);
+  }
+
+  // Batched bounded variant: 'distances[i]' is the bounded distance from 'source' to 'targets[i]' with bound 'bounds[i]',
+  // computed for several targets at once, each in a lane of the vector registers. The source is the pattern of all lanes,
+  // thus its match masks are set once for the batch; sources longer than 64 chars go one target at a time
+  void operator()(std::string_view source, const std::string_view* targets, const uint32_t* bounds, uint32_t* distances, size_t count) {
+    const unsigned m = source.size();
+    if (!m || m > wordSize) {
+      for (size_t i = 0; i != count; ++i)
+        distances[i] = (*this)(source, targets[i], bounds[i]);
+      return;
+    }
+
+    thread_local std::vector<uint32_t> deferred;
+    deferred.clear();
+    uint64_t* peq = singleTable();
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(source[i])] |= uint64_t(1) << i;
+    if (m <= 16)
+      lanesBatch<uint16_t>(peq, m, targets, bounds, distances, count, deferred);
+    else if (m <= 32)
+      lanesBatch<uint32_t>(peq, m, targets, bounds, distances, count, deferred);
+    else
+      lanesBatch<uint64_t>(peq, m, targets, bounds, distances, count, deferred);
+    for (unsigned i = 0; i != m; ++i)
+      peq[static_cast<uint8_t>(source[i])] = 0;
+
+    // The table is clear again, the scalar variant can use it
+    for (auto i : deferred)
+      distances[i] = (*this)(source, targets[i], bounds[i]);
+  }
+};
+
+#endif /* _LEVENSHTEIN_HPP_ */
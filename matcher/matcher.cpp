@@ -2,652 +2,440 @@
 #include <cstdlib>
 #include <fstream>
 #include <string>
-#include <regex>
-#include <cassert>
-#include <cmath>
-#include <numeric>
-#include <algorithm>
-#include <unordered_map>
+#include <sstream>
+#include <thread>
 #include <unordered_set>
-#include "bk_tree.hpp"
+#include <unistd.h>
+#include "matcher.hpp"
+#include "incremental.hpp"
+#include "parallel.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "translation_graph.hpp"
 
 using namespace std;
 
-// #define DEBUG
-
-#define MIN_LEN 5
-#define SEARCH_PRECISION 1
-#define DE_REGEX_MODE 1
-#define EN_REGEX_MODE 0
-
-struct levenshteinDistance {
-  private:
-  // Efficient implementation of Levenshtein Distance 
-  uint32_t impl(const string& source, const string& target) {
-    if (source.size() > target.size())
-      return impl(target, source);
-
-    const unsigned min_size = source.size(), max_size = target.size();
-    vector<unsigned> levDist(min_size + 1);
-
-    levDist[0] = 0;
-    for (unsigned i = 1; i <= min_size; ++i)
-      levDist[i] = i;
-
-    for (unsigned j = 1; j <= max_size; ++j) {
-      unsigned previous_diagonal = levDist[0], previous_diagonal_save;
-      levDist[0] += 1;
-
-      for (unsigned i = 1; i <= min_size; ++i) {
-        previous_diagonal_save = levDist[i];
-        
-        if (source[i - 1] == target[j - 1]) {
-          levDist[i] = previous_diagonal;
-        } else {
-          levDist[i] = min(min(levDist[i - 1] + 1, levDist[i] + 1), previous_diagonal + 1);
-        }
-        previous_diagonal = previous_diagonal_save;
-      }
-    }
-    return levDist[min_size];
-  }
-  
-  public:
-  uint32_t operator()(const string &source, const string &target) {
-    return impl(source, target);
-  }
-};
-
-// The typedefs
-typedef vector<string> VS;
-typedef vector<uint32_t> VI;
-typedef unordered_map<string, VI> hashTable;
-typedef unordered_set<string> SoS;
-typedef unordered_set<uint32_t> SoI;
-typedef unordered_map<uint32_t, uint32_t> freqTable;
-typedef unordered_map<uint32_t, string> medicineIndex;
-typedef storage::bktree<string, uint32_t, levenshteinDistance> metricTree;
-
-// Left trim
-string ltrim(const string& s) {
-	return regex_replace(s, regex("^[\\s-,']+"), string(""));
-}
-
-// Right trim
-string rtrim(const string& s) {
-	return regex_replace(s, regex("[\\s-,']+$"), string(""));
-}
-
-// Both trim
-string trim(const string& s) {
-	return ltrim(rtrim(s));
-}
-
-// Cast the string to lowercase
-string strToLower(const string& str) {
-  string ret;
-  for (unsigned index = 0, limit = str.size(); index != limit; ++index)
-    ret.push_back(tolower(str[index]));
-  return ret;
-}
-
-static vector<string> invalid = {
-  // Empty word
-  "",
-  // Related to medicins
-  "g", "mg", "mcg", "ml", "mikrogramm", "unit"
-  // Related to grammar
-  "zur", "zum", "in", "eine", "einer", "ohne"
+// The index over the medicines of a target language: the vocabulary, its posting lists and the BK-Tree, along with the deletion index
+// (and the similar words of the parts of the input, with --fuzzy join)
+struct target {
+  string language;
+  medSnapshot index;
+  deletionIndex deletions;
+  similarityJoin join;
+  indexChanges changes;
 };
 
-// Check if 'str' appears in 'invalid'
-bool isInvalid(const string& str) {
-  if (str.size() == 1)
-    return true;
-  auto casted = strToLower(str);
-  return any_of(invalid.begin(), invalid.end(), [&casted](string& elem){ return casted == elem; });
-}
-
-bool hasOnlyDigits(const string& str) {
-  return all_of(str.begin(), str.end(), ::isdigit);  
-}
-
-// Split 'str' into parts
-enum class SplitMode {DE, EN, EN_PRICE};
-vector<string> splitUpWithRegex(const string& str, SplitMode mode) {
-  string ret;
-  switch (mode) {
-    // Do not change these options! (unless you are sure about that)
-    case SplitMode::DE: ret = "[-,]+"; break; // supporting german references
-    case SplitMode::EN: ret = "[\\s-,/'`]+"; break; // supporting drugbank synonyms
-    case SplitMode::EN_PRICE: ret = "[\\s-,/'`=.%]+"; break; // supporting drugbank prices
-  }
-  regex rgx(ret);
-  sregex_token_iterator iter(str.begin(), str.end(), rgx, -1), end;
-  vector<string> result;
-  for (; iter != end; ++iter) {
-    string curr(*iter);
-    if (curr.empty())
-      continue;
-    if ((mode == SplitMode::DE) or (mode == SplitMode::EN_PRICE)) {
-      if (hasOnlyDigits(curr))
-        continue;
-      curr.erase(std::remove_if(std::begin(curr), std::end(curr), ::isdigit), curr.end());
-      if (isInvalid(curr))
-        continue;
+int main(int argc, char** argv) {
+  // The program receives the .csv file of Drugbank database, either its vocabulary (drugbank_vocabulary.csv) or as already parsed
+  // along with the prices (en_meds.csv), or serves the queries of other processes, when started with '--serve'
+  // Example: ./match ../meds/en_meds.csv --vocabulary ../drugbank_vocabulary.csv
+  //          ./match ../drugbank_vocabulary.csv
+  //          ./match ../meds/en_meds.csv --languages de,ro
+  //          ./match --serve /tmp/langsome.sock
+  //          ./match ../meds/en_meds.csv --serve /tmp/langsome.sock
+  //          ./match ../meds/en_meds.csv --shard 0/2 && ./match ../meds/en_meds.csv --shard 1/2 && ./match ../meds/en_meds.csv --merge 2
+  if (argc < 2)
+    exit(0);
+  
+  // Parse the options
+  // --languages <l1,l2,..>: the target languages (by default "de"), whose lists ../meds/<l>_meds.csv are all matched in one pass
+  // --meds <dir>: the directory of the lists instead of ../meds (e.g. a synthetic corpus)
+  // --vocabulary <file>: the Drugbank vocabulary which en_meds.csv has been parsed from, for the Drugbank ids in the binary graph
+  //                      (the vocabulary as database file has them already; without ids, the binary graph is not written)
+  // --index <file>: the snapshot of the index, which is mapped if up-to-date and (re)written otherwise (<file>.<l> with several languages)
+  // --threads <n>: the number of threads matching the rows (0 for one per core)
+  // --serve <socket>: answer queries on the Unix domain socket <socket> instead of matching a file
+  //                   (given the database file too, the queries of "en" are matched against its English medicines)
+  // --fuzzy <bktree|frontier|deletion|join>: the index searching for similar parts (by default the deletion index, which gives the same matching);
+  //                                          'frontier' searches the BK-Tree a frontier of nodes at a time, their distances computed in the SIMD lanes;
+  //                                          'join' reads all rows first and joins their distinct parts at once against each vocabulary,
+  //                                          the matching then looking the similar words up (the other parts still use the deletion index)
+  // --compress-postings: keep the posting lists delta+varint encoded in the index
+  // --incremental <file>: keep the matching of the rows in <file> and only match again the rows affected by the changes
+  //                       of both lists since the previous run (the index is then updated rather than rebuilt, by default in <file>.index)
+  // --top-k <k>: rank the matched rows of each row and keep the k best, written as "<row>:<score>" (the score in millionths)
+  // --shard <i>/<n>[:hash]: match only the shard i of n of the rows, either consecutive rows or, with ":hash", the rows by their fingerprint,
+  //                         into "graph.matched.<i>-of-<n>" (the rows keep their index in the whole database file)
+  // --merge <n>: merge the outputs of the n shards of the database file into "graph.matched", the output of a single process
+  //             (and write the binary graph)
+  string databankFileName, vocabularyFileName, indexFileName, socketFileName, stateFileName;
+  VS languages = {"de"};
+  bool useDeletionIndex = true, useFrontiers = false, useJoin = false;
+  postingFormat format = postingFormat::plain;
+  unsigned threadCount = 1;
+  uint32_t topK = 0, mergeCount = 0;
+  shardSpec shard;
+  bool sharded = false;
+  for (int arg = 1; arg < argc; ++arg) {
+    string option(argv[arg]);
+    if ((arg == 1) && (option.compare(0, 2, "--"))) {
+      databankFileName = option;
+    } else if ((option == "--languages") && (arg + 1 < argc)) {
+      languages.clear();
+      forEachPart(argv[++arg], SplitMode::EN, [&languages](string_view language) { languages.emplace_back(language); });
+    } else if ((option == "--meds") && (arg + 1 < argc)) {
+      medsDirectory() = string(argv[++arg]) + "/";
+    } else if ((option == "--vocabulary") && (arg + 1 < argc)) {
+      vocabularyFileName = argv[++arg];
+    } else if ((option == "--serve") && (arg + 1 < argc)) {
+      socketFileName = argv[++arg];
+    } else if ((option == "--index") && (arg + 1 < argc)) {
+      indexFileName = argv[++arg];
+    } else if ((option == "--threads") && (arg + 1 < argc)) {
+      threadCount = atoi(argv[++arg]);
+      if (!threadCount)
+        threadCount = max(1u, thread::hardware_concurrency());
+    } else if ((option == "--fuzzy") && (arg + 1 < argc) && ((string(argv[arg + 1]) == "bktree") || (string(argv[arg + 1]) == "frontier") || (string(argv[arg + 1]) == "deletion") || (string(argv[arg + 1]) == "join"))) {
+      string fuzzy(argv[++arg]);
+      useDeletionIndex = (fuzzy == "deletion") || (fuzzy == "join");
+      useFrontiers = (fuzzy == "frontier");
+      useJoin = (fuzzy == "join");
+    } else if ((option == "--incremental") && (arg + 1 < argc)) {
+      stateFileName = argv[++arg];
+    } else if ((option == "--top-k") && (arg + 1 < argc) && (atoi(argv[arg + 1]) > 0)) {
+      topK = atoi(argv[++arg]);
+    } else if ((option == "--shard") && (arg + 1 < argc) && (shard.parse(argv[arg + 1]))) {
+      sharded = true;
+      ++arg;
+    } else if ((option == "--merge") && (arg + 1 < argc) && (atoi(argv[arg + 1]) > 0)) {
+      mergeCount = atoi(argv[++arg]);
+    } else if (option == "--compress-postings") {
+      format = postingFormat::varint;
+    } else {
+      cerr << "unknown option \"" << option << "\"" << endl;
+      exit(1);
     }
-    result.push_back(curr);
   }
-  return result;
-}
-
-// Get rid of any type of paranthesis. Note that if 'str' has not been correctly bracketed, the empty string is returned
-string cleanUp(string& str) {
-  auto isOpen = [](char c) -> bool {
-    return (c == '(') || (c == '[') || (c == '{');
-  };
   
-  auto isClose = [](char c) -> bool {
-    return (c == ')') || (c == ']') || (c == '}');
-  };
-  
-  // Analyze the string with a stack of paranthesis
-  string ret, empty;
-  vector<char> stack;
-  for (auto c : str) {
-    if (isOpen(c)) {
-      stack.push_back(c);
-    } else if (isClose(c)) {
-      if ((!stack.empty()) && (stack.back() == ((c == ')') ? '(' : ((c == ']') ? '[' : '{'))))
-        stack.pop_back();
-      else
-        return empty;
-    } else if (stack.empty()) {
-      ret += c;
-    }
+  // Check for file
+  if ((databankFileName.empty()) && (socketFileName.empty())) {
+    cerr << "empty database file name" << endl;
+    exit(1);
   }
-  ret = trim(ret);
-  return stack.empty() ? ret : empty;
-}
-
-void dissolveMeds(string language, hashTable& table, medicineIndex& medIndex) {
-  // Check the language (only German by now)
-  if (language != "de") {
-    cerr << "Language " << language << " not supported yet!" << endl;
-    return;
+  sort(languages.begin(), languages.end());
+  languages.erase(unique(languages.begin(), languages.end()), languages.end());
+  if (languages.empty()) {
+    cerr << "no target language" << endl;
+    exit(1);
   }
-  
-  // Open the input file
-  string completePath = string("../meds/") + language + string("_meds.csv");
-  ifstream input(completePath);
-  
-  unsigned medRow = 0;
-  for (string medicine; input >> medicine; medRow++) {
-    // Store the current medicine
-    medIndex[medRow] = medicine;
-    
-    // Split the current medicine (since we only have the reference to it)
-    vector<string> parts = splitUpWithRegex(medicine, SplitMode::DE);
-    if (parts.empty())
-      continue;
-    
-    // Do not consider the last part, since that is the unique id of the medicine
-    for (unsigned index = 0, limit = parts.size() - 1; index != limit; ++index) {
-      auto word = strToLower(parts[index]);
-      // It could be the case that a word occurs twice in the same medicine, e.g. "alfa"
-      if ((table[word].empty()) || (table[word].back() != medRow)) 
-        table[word].push_back(medRow);
+  for (auto& language : languages) {
+    if (!ifstream(medsFileName(language)).is_open()) {
+      cerr << "file \"" << medsFileName(language) << "\" could not open" << endl;
+      exit(1);
     }
   }
-  input.close();
-}
-
-// Build up the metric tree
-void buildStorage(const hashTable& table, metricTree& container) {
-  for (auto elem : table)
-    container.insert(elem.first);
-}
-
-// Analyze the line and parse the common name along with its synonyms, which are not chemical formulas
-pair<string, pair<VS, VS>> analyzeLine(string line) {
-  // Check for empty line
-  if (line.empty()) {
-    vector<string> empty;
-    return make_pair(line, make_pair(empty, empty));
+  if ((!stateFileName.empty()) && (languages.size() != 1)) {
+    cerr << "--incremental supports a single target language" << endl;
+    exit(1);
   }
-
-  // Lambda-expression to check if the current char is a paranthesis
-  // Words which contain at least a complex paranthesis are chemical formulas, thus, we are not interested in them
-  auto isComplexParanthesis = [](char c) -> bool {
-    return (c == '[') || (c == ']') || (c == '{') || (c == '}');
-  };
-  // There could be the case that a simple paranthesis only marks an explanation, e.g. Insuline (human) 
-  auto isSimpleParanthesis = [](char c) -> bool {
-    return (c == '(') || (c == ')');
-  };
-  
-  // Extract the common name
-  string commonName;
-  unsigned index = 0;
-  bool hadSimpleParanthesis = false, hadComplexParanthesis = false;
-  for (bool activate = false; index != line.size(); ++index) {
-    if (line[index] == '"') {
-      activate = !activate;
-    } else {
-      if ((!activate) && (line[index] == ','))
-        break;
-      hadSimpleParanthesis |= isSimpleParanthesis(line[index]);
-      hadComplexParanthesis |= isComplexParanthesis(line[index]);
-      commonName += line[index];
-    }
+  if ((!stateFileName.empty()) && (topK)) {
+    cerr << "--incremental does not keep the scores of --top-k" << endl;
+    exit(1);
   }
-  // If common name contained a complex paranthesis, that's for sure a chemical formula
-  if (hadComplexParanthesis) {
-    commonName.clear();
-  } else if (hadSimpleParanthesis) {
-    // Otherwise, it could be only an explanation, which is not that harmful
-    commonName = cleanUp(commonName);
+  if ((sharded) && ((!stateFileName.empty()) || (!socketFileName.empty()) || (mergeCount))) {
+    cerr << "--shard does not apply to --incremental, --serve or --merge" << endl;
+    exit(1);
   }
   
-  // Can we deploy the result earlier?
-  vector<string> synonyms, prices;
-  if ((commonName.empty()) || (index == line.size()))
-    return make_pair(commonName, make_pair(synonyms, prices));
-  
-  // Append an element (synonym or price) to its corresponding list, depending on 'beginOfPrices'
-  bool hasSimpleParanthesis = false, hasComplexParanthesis = false, beginOfPrices = false;
-  auto appendElem = [&synonyms, &prices, &hasSimpleParanthesis, &hasComplexParanthesis, &beginOfPrices](string& elem) -> void {
-    if (elem.empty())
-      return;
-    if (hasComplexParanthesis)
+  // The graph of German, which the translator reads, is "graph.matched", the one of language <l> "graph.<l>.matched".
+  // Once matched, each graph is written in binary as well ("graph.bin", "graph.<l>.bin"), along with the medicines of both sides
+  // (the rows of the database file and the list), or else the program fails. Without the Drugbank ids (en_meds.csv without --vocabulary),
+  // the binary graph is not written, and a previous one removed: the translator then reads "graph.matched" with the vocabulary instead
+  auto graphFileName = [](const string& language, const string& extension) -> string {
+    return (language == "de") ? ("graph." + extension) : ("graph." + language + "." + extension);
+  };
+  auto writeTranslationGraph = [&graphFileName, &databankFileName, &vocabularyFileName](const string& language) -> void {
+    translationGraph graph;
+    string fileName = graphFileName(language, "bin");
+    if ((vocabularyFileName.empty()) && (!hasDrugbankIds(databankFileName))) {
+      cerr << "graph \"" << fileName << "\" not written: \"" << databankFileName << "\" has no Drugbank ids, give its vocabulary with --vocabulary" << endl;
+      remove(fileName.c_str());
       return;
-    if (hasSimpleParanthesis)
-      elem = cleanUp(elem);
-    if (beginOfPrices)
-      prices.push_back(trim(elem));
-    else
-      synonyms.push_back(trim(elem));
-    hasSimpleParanthesis = hasComplexParanthesis = false;
-    elem.clear();
+    }
+    if (!buildTranslationGraph(language, databankFileName, vocabularyFileName, graphFileName(language, "matched"), graph))
+      exit(1);
+    if (!graph.save(fileName)) {
+      cerr << "graph \"" << fileName << "\" could not be written" << endl;
+      exit(1);
+    }
   };
   
-  string curr;
-  bool activate = false;
-  unsigned distance = 1;
-  for (++index; index != line.size(); ++index) {
-    if (line[index] == '"') {
-      activate = !activate;
-    } else {
-      // End of synonym?
-      if (line[index] == '|') {
-        appendElem(curr);
-        distance = 0;
-      } else {
-        // Update the word and its status
-        hasSimpleParanthesis |= isSimpleParanthesis(line[index]);
-        hasComplexParanthesis |= isComplexParanthesis(line[index]);
-        
-        // If the medicine starts exactly after a bar, that is where the prices begin to appear
-        if ((!distance) && (line[index] != ' '))
-          beginOfPrices = true;
-        curr += line[index];
-        ++distance;
-      }
+  // Merge the outputs of the shards of each target, no index needed
+  if (mergeCount) {
+    for (auto& language : languages) {
+      if (!mergeShards(graphFileName(language, "matched"), mergeCount))
+        exit(1);
+      writeTranslationGraph(language);
     }
+    return 0;
   }
-  // And append the last synonym, only if did not contain any complex paranthesis
-  appendElem(curr);
   
-  // And deploy
-  return make_pair(commonName, make_pair(synonyms, prices));
-}
-
-int main(int argc, char** argv) {
-  // The program receives the .csv file of Drugbank database, which has been already parsed (en_meds.csv)
-  // Example: ./match ../meds/en_meds.csv
-  if (argc < 2)
-    exit(0);
-  
-  // Check for file
-  string databankFileName(argv[1]);
-  if (databankFileName.empty()) {
-    cerr << "empty database file name" << endl;
-    exit(1);
+  // Load the index of each target language, in parallel. When serving along with the database file, the English medicines
+  // (their common names and synonyms) are indexed as well, as the target "en" of the queries from the other languages
+  bool reverse = (!socketFileName.empty()) && (!databankFileName.empty());
+  vector<target> targets(languages.size() + reverse);
+  {
+    auto loadTarget = [&](target& t, const string& language) -> void {
+      t.language = language;
+      string fileName = ((languages.size() == 1) || (indexFileName.empty())) ? indexFileName : (indexFileName + "." + language);
+      if (language == "en") {
+        loadEnglishIndex(databankFileName, indexFileName.empty() ? indexFileName : (indexFileName + ".en"), t.index, format);
+      } else if (!stateFileName.empty()) {
+        if (fileName.empty())
+          fileName = stateFileName + ".index";
+        loadIndexIncrementally(language, fileName, t.index, t.changes, format);
+      } else {
+        loadIndex(language, fileName, t.index, format);
+      }
+      if (useDeletionIndex) {
+        STATS_PHASE(buildDeletions);
+        t.deletions.build(t.index.tree(), SEARCH_PRECISION);
+      }
+    };
+    const string english = "en";
+    vector<thread> loaders;
+    for (size_t pos = 1; pos < targets.size(); ++pos)
+      loaders.emplace_back(loadTarget, ref(targets[pos]), cref((pos < languages.size()) ? languages[pos] : english));
+    loadTarget(targets[0], languages[0]);
+    for (auto& loader : loaders)
+      loader.join();
   }
-  
-  // 'word2index' saves the indexes in file for each part of medicine
-  hashTable word2index;
-  
-  // 'medIndex' tells us which medicine is to be found at a certain index (row)
-  medicineIndex medIndex;
-  
-  // Split up the medicines to which we translate 
-  dissolveMeds("de", word2index, medIndex);
-
-  // Filter out the parts which are way too small
-  VS mayBeEliminated;
-  for (auto elem : word2index)
-    if (elem.first.length() < MIN_LEN)
-      mayBeEliminated.push_back(elem.first);
-  for (auto elem : mayBeEliminated)
-    word2index.erase(elem);
-  
-  // Save the parts into a BK-Tree.
-  metricTree container;
-  buildStorage(word2index, container);
-  
-  auto printIndex = [&medIndex](const VI& v) -> void {
-    for (auto elem : v) {
-      cout << "(" << elem << " -> " << medIndex[elem] << "), ";
+  auto fuzzyIndexOf = [useDeletionIndex](const target& t) -> const deletionIndex* {
+    return useDeletionIndex ? &t.deletions : nullptr;
+  };
+  auto makeMatchers = [&targets, &fuzzyIndexOf, topK, useFrontiers]() -> vector<Matcher> {
+    vector<Matcher> matchers;
+    for (auto& t : targets) {
+      matchers.emplace_back(t.index, fuzzyIndexOf(t));
+      matchers.back().rankTop(topK);
+      matchers.back().searchFrontiers(useFrontiers);
     }
-    cout << endl;
+    return matchers;
   };
   
-  auto solveSplittedCase = [&word2index, &container](VS& splitted, string optional = "") -> VI {
-    // Sum up the Levenshtein distances of the edges
-    freqTable indexCloseness;
-    
-    // Count how many times the index has been used
-    freqTable indexCount;
-    
-    // Each part, if not directly found in 'word2index', can have many similar parts in the file
-    // Thus, we do not want to repeat an index, if it should appear at 2 different parts
-    SoI rowBitMap;
-    
-    // Pick only the unique parts in 'splitted'
-    SoS unique(splitted.begin(), splitted.end());
-   
-    VS acceptedParts;
-    for (auto part : unique) {
-      if (part.length() < MIN_LEN)
-        continue;
-      if (hasOnlyDigits(part))
-        continue;
-      
-      // Check if the part can be directly found in 'word2index'
-      auto iter = word2index.find(part);
-      if (iter != word2index.end()) {
-        // If so, the Levenshtein distance is 0, so only increase the count of the index
-        acceptedParts.push_back(part);
-        for (auto index : word2index[part])
-          indexCount[index]++;
-      } else {
-        // Search for similar parts
-        auto devs = container.find_within(part, SEARCH_PRECISION);
-        if (!devs.empty()) {
-          acceptedParts.push_back(part);
-          rowBitMap.clear();
-          for (auto dev : devs) {
-            auto selectedWord = dev.first;
-            auto levDistance = dev.second;
-            
-            // And update with the indexes of the word
-            for (auto index : word2index[selectedWord]) {
-              // First check if the index has not yet appeared for 'part'
-              if (rowBitMap.find(index) == rowBitMap.end()) {
-                indexCloseness[index] += levDistance;
-                indexCount[index]++;
-                rowBitMap.insert(index);
-              }
-            }
-          }
-        }
+  // Serve the queries of other processes: each request is a line "<target language> <name>", e.g. "de Cetuximab"
+  // (or, with the database file, "en Aciclovir-Creme", a medicine of a target language, split as in its list).
+  // The response lists the matched medicines, closest first, one per line as "<row>\t<closeness>\t<medicine>", followed by an empty line
+  // (with --top-k, the k best ones, as "<row>\t<score>\t<medicine>").
+  // A line longer than MAX_REQUEST_LENGTH, or a client beyond the MAX_CLIENTS served at once, gets "error: ..." and is hung up on
+  if (!socketFileName.empty()) {
+    cerr << "Serving on " << socketFileName << ".." << endl;
+    bool served = serveUnixSocket(socketFileName, [&targets, &makeMatchers](const string& request, string& response) -> void {
+      thread_local vector<Matcher> matchers = makeMatchers();
+      auto separator = request.find(' ');
+      string language = request.substr(0, separator);
+      string name = (separator == string::npos) ? string() : trim(string_view(request).substr(separator + 1));
+      auto t = find_if(targets.begin(), targets.end(), [&language](const target& t) { return t.language == language; });
+      if (t == targets.end()) {
+        response += "error: language " + language + " not supported\n\n";
+        return;
       }
-    }
-    
-    // Custom function to determine how many times an index should appear
-    auto analyzeAcceptedParts = [&splitted, &acceptedParts]() -> uint32_t {
-      // The threshold for the soft-max function
-      static constexpr double threshold = 1.0 / exp(1);
       
-      // The lower-bound of the number of accepted parts
-      auto lowerBound = static_cast<uint32_t>(splitted.size() / 2);
-      
-      // We are very restrictive
-      if ((splitted.size() % 2) or (splitted.size() == 2))
-        return lowerBound + 1;
-    
-      // Compute the soft-max of the lengths
-      auto computeSoftMax = [&splitted, &acceptedParts]() -> double {
-        auto addExp = [](const VS& parts) -> double {
-          return accumulate(parts.begin(), parts.end(), 0, [](double acc, const string& part) {
-            return acc + exp(part.length());
-          });
-        };
-        
-        // And return the ratio
-        return addExp(acceptedParts) / addExp(splitted);
-      };
-      
-      // Compute the lower-bound, after having analyzed the lengths of the accepted parts
-      uint32_t offset = (acceptedParts.size() == lowerBound) ? (computeSoftMax() < threshold) : 1;
-      return lowerBound + offset;
-    };
-
-    // First check if the lower bound has been respected
-    VI bestIndexes;
-    auto currentAcceptedSize = analyzeAcceptedParts();
-    if (acceptedParts.size() < currentAcceptedSize)
-      return bestIndexes;
-    
-    // And find the best indexes, where the medicines can be matched with the current medicine (its parts are in splitted)
-    uint32_t maxIndexCount = 0, minCloseness = numeric_limits<uint32_t>::max();
-    for (auto [index, count] : indexCount) {
-      if (count < currentAcceptedSize)
-        continue;
-      if (count > maxIndexCount) {
-        maxIndexCount = count;
-        minCloseness = indexCloseness[index];
-        bestIndexes.clear();
-        bestIndexes.push_back(index);
-      } else if ((count == maxIndexCount) && (indexCloseness[index] < minCloseness)) {
-        minCloseness = indexCloseness[index];
-        bestIndexes.push_back(index);
+      scoredRows rows;
+      if (!name.empty())
+        matchers[t - targets.begin()].matchName(name, parseName(name, (language == "en") ? SplitMode::DE : SplitMode::EN), rows);
+      if (!matchers[t - targets.begin()].ranked())
+        stable_sort(rows.begin(), rows.end(), [](const pair<uint32_t, uint32_t>& a, const pair<uint32_t, uint32_t>& b) {
+          return a.second < b.second;
+        });
+      for (auto [row, closeness] : rows) {
+        response += to_string(row) + "\t" + to_string(closeness) + "\t";
+        response += t->index.medicine(row);
+        response += "\n";
       }
-    }
-    
-    // And return the best indexes
-    return bestIndexes;
-  };
+      response += "\n";
+    });
+    cerr << "socket \"" << socketFileName << "\" could not be set up" << endl;
+    return served ? 0 : 1;
+  }
   
   // Open the input file
   cerr << "Start parsing the english medicines.." << endl;
-  ifstream in(databankFileName);
-  if (!in.is_open()) {
+  drugbankReader in;
+  if (!in.open(databankFileName)) {
     cerr << "file \"" << databankFileName << "\" could not open" << endl;
     exit(1);
   }
   
-  // Open the output file
-  string outputFile = "graph.matched";
-  ofstream out(outputFile);
+  // Open the output files (those of the shard, which only the merge turns into the graphs). Each one is written under a name unique
+  // to the process and renamed once complete, thus a process killed midway leaves no truncated output for the translator or the merge
+  VS outFileNames;
+  vector<ofstream> outs;
+  auto tempFileName = [](const string& fileName) -> string { return fileName + ".tmp." + to_string(getpid()); };
+  for (auto& t : targets) {
+    outFileNames.push_back(sharded ? shard.fileName(graphFileName(t.language, "matched")) : graphFileName(t.language, "matched"));
+    outs.emplace_back(tempFileName(outFileNames.back()));
+  }
+  auto writeTranslationGraphs = [&]() -> void {
+    for (size_t t = 0; t != outs.size(); ++t) {
+      outs[t].close();
+      if ((!outs[t]) || (rename(tempFileName(outFileNames[t]).c_str(), outFileNames[t].c_str()))) {
+        cerr << "file \"" << outFileNames[t] << "\" could not be written" << endl;
+        remove(tempFileName(outFileNames[t]).c_str());
+        exit(1);
+      }
+      if (!sharded)
+        writeTranslationGraph(targets[t].language);
+    }
+  };
   
-  // Analyze the common name
-  auto analyzeCommonName = [&out, &word2index, &container, &solveSplittedCase, &printIndex](const uint32_t rowIndex, const string& commonName) -> bool {
-    // Check if the medicine has the same name in the other language
-    static constexpr bool commonNameSolved = true;
-    auto castedName = strToLower(commonName);
-    auto iter = word2index.find(castedName);
-    
-    // Is the medicine similar in German?
-    if (iter != word2index.end()) {
-      // Save the matching
-      out << (rowIndex - 1);
-      for (auto index : iter->second)
-        out << " " << index;
+  // Write the matched rows of a batch, one line per matched row of the database file: its (0-based) index followed by the rows of the target
+  // (ranked, along with their scores, with --top-k). The rows of a shard are looked up in 'rowNumbers', their indices in the database file
+  auto writeBatch = [topK](ostream& out, uint32_t batchStart, const vector<Matcher::result>& results, const VI* rowNumbers = nullptr) -> void {
+    for (size_t pos = 0; pos != results.size(); ) {
+      uint32_t query = results[pos].query;
+      out << (rowNumbers ? (*rowNumbers)[batchStart + query] : (batchStart + query));
+      for (; (pos != results.size()) && (results[pos].query == query); ++pos) {
+        out << " " << results[pos].row;
+        if (topK)
+          out << ":" << results[pos].score;
+      }
       out << endl;
-#ifdef DEBUG
-      cout << "en = de: " << commonName << endl;
-#endif  
-      return commonNameSolved;
     }
-    
-    // Find possible deviations from the common name
-    auto splittedName = splitUpWithRegex(castedName, SplitMode::EN);
-    if (splittedName.empty())
-      return commonNameSolved;
-    
-    if (splittedName.size() == 1) {
-      auto single = splittedName.front();
-      iter = word2index.find(single);
-      if (iter != word2index.end()) {
-        out << (rowIndex - 1);
-        for (auto index : iter->second)
-          out << " " << index;
-        out << endl;
-#ifdef DEBUG
-        cout << "en ~ de: " << commonName << endl;
-#endif
-        return commonNameSolved;
-      }
-      auto deviated = container.find_within(single, SEARCH_PRECISION);
-      if (!deviated.empty()) {
-        // Save the matching
-        SoI rowBitMap;
-        out << (rowIndex - 1);
-        for (auto part : deviated) {
-          for (auto index : word2index[part.first]) {
-            if (rowBitMap.find(index) == rowBitMap.end()) {
-              rowBitMap.insert(index);
-              out << " " << index; 
-            }
-          }
-        }
-        out << endl;
-        rowBitMap.clear();
-#ifdef DEBUG
-        cout << "Deviated: " << commonName << ": ";
-        for (auto part : deviated)
-          cout << "part=" << part.first << ", ";
-        cout << endl;
-#endif
-        return commonNameSolved;
-      }
-    } else {
-      VI bestIndexes = solveSplittedCase(splittedName, commonName);
-      if (!bestIndexes.empty()) {
-        // Save the matching
-        out << (rowIndex - 1);
-        for (auto index : bestIndexes)
-          out << " " << index;
-        out << endl;
-#ifdef DEBUG
-        cout << "%%%: " << commonName;
-        printIndex(bestIndexes);
-#endif          
-        return commonNameSolved;
-      }
+  };
+  
+  // Match the rows of a batch against every target, each row being parsed only once
+  // (unless all rows have been parsed beforehand, into 'parsedRows')
+  auto matchBatch = [](vector<Matcher>& matchers, const vector<drugbankRecord>& rows, size_t first, size_t last,
+                       vector<vector<Matcher::result>>& results, const vector<parsedRow>* parsedRows = nullptr) -> void {
+    vector<string_view> queries;
+    vector<parsedRow> parsed;
+    queries.reserve(last - first);
+    if (!parsedRows)
+      parsed.reserve(last - first);
+    for (size_t row = first; row != last; ++row) {
+      queries.push_back(rows[row].record);
+      if (!parsedRows)
+        parsed.push_back(parseRecord(rows[row]));
+    }
+    const parsedRow* batchRows = parsedRows ? (parsedRows->data() + first) : parsed.data();
+    results.resize(matchers.size());
+    for (size_t t = 0; t != matchers.size(); ++t) {
+      results[t].clear();
+      matchers[t].matchRows(queries.data(), batchRows, queries.size(), results[t]);
     }
-    return !commonNameSolved;
   };
   
-  // Analyze a type of list, either synonyms or prices
-  auto analyzeResemblances = [&out, &word2index, &container, &solveSplittedCase, &printIndex](const uint32_t rowIndex, const string& commonName, const VS& list, const string resemblanceType, const SplitMode mode) -> bool {
-    static constexpr bool resemblanceListSolved = true;
-    if (list.empty())
-      return !resemblanceListSolved;
+  if (!stateFileName.empty()) {
+    // Match again only the rows affected by the changes, and write all rows
+    vector<drugbankRecord> rows;
+    {
+      STATS_PHASE(readRows);
+      for (drugbankRecord row; in.next(row); )
+        rows.push_back(row);
+    }
     
-    // Check the list
-    for (auto elem : list) {
-      auto castedElem = strToLower(elem);
-      auto splittedElem = splitUpWithRegex(castedElem, mode);
-      if (splittedElem.empty())
+    STATS_PHASE(matching);
+    auto& t = targets.front();
+    Matcher matcher(t.index, fuzzyIndexOf(t));
+    matcher.searchFrontiers(useFrontiers);
+    matchState previous, current;
+    previous.load(stateFileName);
+    vector<VI> matched;
+    uint32_t rematched = matchIncrementally(matcher, rows, previous, t.changes, current, matched);
+    for (uint32_t row = 0; row != matched.size(); ++row) {
+      if (matched[row].empty())
         continue;
-      
-      // If 'elem' consists of only one part
-      if (splittedElem.size() == 1) {
-        auto single = splittedElem.front();
-        
-        // Check if 'single' can be directly found
-        auto castedSingle = strToLower(single);
-        auto iter = word2index.find(castedSingle);
-        if (iter != word2index.end()) {
-          // Save the matching
-          out << (rowIndex - 1);
-          for (auto index : iter->second)
-            out << " " << index;
-          out << endl;
-#ifdef DEBUG
-          cout << "en (" << resemblanceType << ") de: " << commonName << " -> " << single << endl;
-#endif
-          return resemblanceListSolved; 
-        } else {
-          auto similarGermanParts = container.find_within(castedSingle, SEARCH_PRECISION);
-          if (!similarGermanParts.empty()) {
-            // Save the matching
-            SoI rowBitMap;
-            out << (rowIndex - 1);
-            for (auto part : similarGermanParts) {
-              for (auto index : word2index[part.first]) {
-                if (rowBitMap.find(index) == rowBitMap.end()) {
-                  rowBitMap.insert(index);
-                  out << " " << index;
-                }
-              }
-            }
-            out << endl;
-            rowBitMap.clear();
-#ifdef DEBUG
-            cout << "Found in list " << single << ": ";
-            for (auto part : similarGermanParts)
-              cout << "commonName=" << commonName << " -> " << part.first << ", ";
-            cout << endl;
-#endif
-            return resemblanceListSolved;
-          }
-        }
-      } else {
-        // Analyze 'castedElem' when there are many more parts
-        VI bestIndexes = solveSplittedCase(splittedElem, elem);
-        if (!bestIndexes.empty()) {
-          // Save the matching
-          out << (rowIndex - 1);
-          for (auto index : bestIndexes)
-            out << " " << index;
-          out << endl;            
-#ifdef DEBUG
-          cout << "*** Multiple : common=" << commonName << " " << resemblanceType << "=" << elem;
-          printIndex(bestIndexes);
-#endif
-          return resemblanceListSolved;
+      outs.front() << row;
+      for (auto targetRow : matched[row])
+        outs.front() << " " << targetRow;
+      outs.front() << "\n";
+    }
+    if (!current.save(stateFileName))
+      cerr << "state \"" << stateFileName << "\" could not be written" << endl;
+    cerr << "Matched " << rematched << " of " << rows.size() << " rows again (" << t.changes.words.size() << " words changed)" << endl;
+    writeTranslationGraphs();
+    return 0;
+  }
+  
+  if ((threadCount > 1) || (sharded) || (useJoin)) {
+    // Read all rows (keeping those of the shard), match them in batches on the workers and write the batches back in the order of the rows
+    vector<drugbankRecord> rows;
+    VI rowNumbers;
+    {
+      STATS_PHASE(readRows);
+      for (drugbankRecord row; in.next(row); )
+        rows.push_back(row);
+      if (sharded) {
+        uint32_t kept = 0;
+        for (uint32_t row = 0; row != rows.size(); ++row) {
+          if (!shard.contains(row, rows.size(), rows[row].record))
+            continue;
+          rows[kept++] = rows[row];
+          rowNumbers.push_back(row);
         }
+        rows.resize(kept);
       }
     }
-    return !resemblanceListSolved;
-  };
+    
+    // With --fuzzy join, parse all rows at once and join their distinct parts against each vocabulary (those not in it),
+    // so that each part is searched once for the whole input rather than once per row
+    vector<parsedRow> parsedRows;
+    if (useJoin) {
+      STATS_PHASE(joinParts);
+      parsedRows.reserve(rows.size());
+      unordered_set<string_view> parts;
+      for (auto& row : rows) {
+        parsedRows.push_back(parseRecord(row));
+        forEachSearchedPart(parsedRows.back(), [&parts](string_view part) { parts.insert(part); });
+      }
+      for (auto& t : targets) {
+        vector<string_view> unknown;
+        for (auto part : parts)
+          if (t.index.find(part) == medSnapshot::npos)
+            unknown.push_back(part);
+        t.join.build(t.index.tree(), SEARCH_PRECISION);
+        t.join.join(move(unknown), threadCount);
+      }
+    }
+    
+    STATS_PHASE(matching);
+    uint32_t batchCount = (rows.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+    vector<vector<Matcher>> matchers(threadCount, makeMatchers());
+    if (useJoin)
+      for (auto& workerMatchers : matchers)
+        for (size_t t = 0; t != targets.size(); ++t)
+          workerMatchers[t].useJoin(&targets[t].join);
+    vector<VS> batchOutputs(batchCount);
+    runOrdered(threadCount, batchCount, [&](uint32_t batch, unsigned worker) {
+      vector<vector<Matcher::result>> results;
+      uint32_t first = batch * BATCH_SIZE;
+      matchBatch(matchers[worker], rows, first, min<size_t>(first + BATCH_SIZE, rows.size()), results, useJoin ? &parsedRows : nullptr);
+      for (auto& targetResults : results) {
+        ostringstream batchOut;
+        writeBatch(batchOut, first, targetResults, sharded ? &rowNumbers : nullptr);
+        batchOutputs[batch].push_back(batchOut.str());
+      }
+    }, [&](uint32_t batch) {
+      for (size_t t = 0; t != outs.size(); ++t)
+        outs[t] << batchOutputs[batch][t];
+      VS().swap(batchOutputs[batch]);
+    });
+    writeTranslationGraphs();
+    return 0;
+  }
   
-  // Analyze each row of the database .csv file
-  string line;
-  unsigned rowIndex = 0;
-  nextMatch : {
-    // Get the next line, if any
-    line.clear();
-    if (getline(in, line)) {
-      rowIndex++;
-      // Analyze the line, i.e extract the common name and its list of synonyms
-      pair<string, pair<VS, VS>> curr = analyzeLine(line);
-      
-      // Check for an empty common nome
-      string commonName = curr.first;
-      if (commonName.empty())
-        goto nextMatch;
-      
-      if (analyzeCommonName(rowIndex, commonName))
-        goto nextMatch;
-      
-      // Analyze the synonyms
-      VS synonyms = curr.second.first;
-      if (analyzeResemblances(rowIndex, commonName, synonyms, "synonym", SplitMode::EN))
-        goto nextMatch;
-      
-      // Analyze the prices
-      VS prices = curr.second.second;
-      if (analyzeResemblances(rowIndex, commonName, prices, "price", SplitMode::EN_PRICE))
-        goto nextMatch;
+  // Analyze the rows of the database .csv file, a batch at a time
+  STATS_PHASE(matching);
+  vector<Matcher> matchers = makeMatchers();
+  vector<drugbankRecord> rows(BATCH_SIZE);
+  vector<vector<Matcher::result>> results;
+  uint32_t rowIndex = 0;
+  nextBatch : {
+    // Get the next rows, if any
+    size_t count = 0;
+    while ((count != BATCH_SIZE) && in.next(rows[count]))
+      ++count;
+    if (count) {
+      matchBatch(matchers, rows, 0, count, results);
+      for (size_t t = 0; t != outs.size(); ++t)
+        writeBatch(outs[t], rowIndex, results[t]);
+      rowIndex += count;
       
       // Continue the loop
-      goto nextMatch;
+      goto nextBatch;
     }
   }
+  writeTranslationGraphs();
   return 0;
 }
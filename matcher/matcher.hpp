@@ -0,0 +1,1212 @@
+#ifndef _MATCHER_HPP_
+#define _MATCHER_HPP_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <cassert>
+#include <thread>
+#include "string_pool.hpp"
+#include "flat_bk_tree.hpp"
+#include "deletion_index.hpp"
+#include "similarity_join.hpp"
+#include "snapshot.hpp"
+#include "levenshtein.hpp"
+#include "tokenizer.hpp"
+#include "csv_reader.hpp"
+#include "stats.hpp"
+
+// #define DEBUG
+
+#define MIN_LEN 5
+#define SEARCH_PRECISION 1
+#define BATCH_SIZE 16
+// The scores of the ranked (top-k) matching are fixed-point, in millionths
+#define SCORE_SCALE 1000000
+#define DE_REGEX_MODE 1
+#define EN_REGEX_MODE 0
+
+// The typedefs
+typedef std::vector<std::string> VS;
+typedef std::vector<uint32_t> VI;
+// The medicine at each row
+typedef std::vector<std::string> medicineIndex;
+// Matched rows, along with their closeness (the sum of the Levenshtein distances of the parts which led to them), or their score when ranked
+typedef std::vector<std::pair<uint32_t, uint32_t>> scoredRows;
+typedef storage::flat_bktree<uint32_t, bitParallelLevenshtein> metricTree;
+typedef std::vector<metricTree::match> treeMatches;
+typedef indexSnapshot<bitParallelLevenshtein> medSnapshot;
+typedef storage::deletion_index<uint32_t, bitParallelLevenshtein> deletionIndex;
+typedef storage::similarity_join<uint32_t, bitParallelLevenshtein> similarityJoin;
+
+// The rows of the medicines containing a word
+struct rowSpan {
+  const uint32_t* first;
+  const uint32_t* last;
+
+  const uint32_t* begin() const { return first; }
+  const uint32_t* end() const { return last; }
+  size_t size() const { return last - first; }
+};
+
+// The posting lists of the interned words, frozen into CSR: the rows of word 'w' are rows[offsets[w] .. offsets[w + 1])
+struct postingStore {
+  VI offsets, rows;
+
+  // Freeze the (word, row) pairs, given in increasing rows, with a counting sort
+  void freeze(const std::vector<std::pair<uint32_t, uint32_t>>& pairs, uint32_t wordCount) {
+    offsets.assign(wordCount + 1, 0);
+    for (auto [word, row] : pairs)
+      offsets[word + 1]++;
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    rows.resize(pairs.size());
+    VI filled(offsets.begin(), offsets.end() - 1);
+    for (auto [word, row] : pairs)
+      rows[filled[word]++] = row;
+  }
+
+  rowSpan operator[](uint32_t word) const {
+    return {rows.data() + offsets[word], rows.data() + offsets[word + 1]};
+  }
+};
+
+// Get rid of any type of paranthesis. Note that if 'str' has not been correctly bracketed, the empty string is returned
+inline std::string cleanUp(std::string_view str) {
+  auto isOpen = [](char c) -> bool {
+    return (c == '(') || (c == '[') || (c == '{');
+  };
+
+  auto isClose = [](char c) -> bool {
+    return (c == ')') || (c == ']') || (c == '}');
+  };
+
+  // Analyze the string with a stack of paranthesis
+  std::string ret, empty;
+  std::vector<char> stack;
+  for (auto c : str) {
+    if (isOpen(c)) {
+      stack.push_back(c);
+    } else if (isClose(c)) {
+      if ((!stack.empty()) && (stack.back() == ((c == ')') ? '(' : ((c == ']') ? '[' : '{'))))
+        stack.pop_back();
+      else
+        return empty;
+    } else if (stack.empty()) {
+      ret += c;
+    }
+  }
+  ret = trim(ret);
+  return stack.empty() ? ret : empty;
+}
+
+// The directory of the lists of medicines (e.g. a synthetic corpus of parser/synthetic.py instead of the real lists)
+inline std::string& medsDirectory() {
+  static std::string directory = "../meds/";
+  return directory;
+}
+
+// The list of medicines written in 'language'
+inline std::string medsFileName(const std::string& language) {
+  return medsDirectory() + language + std::string("_meds.csv");
+}
+
+// Intern the words (of at least MIN_LEN chars) of the medicines written in 'language', along with their posting lists.
+// 'words' may already hold words (e.g. the vocabulary of an earlier index), which keep their ids.
+// The lists of all languages have the format of the German one: a medicine per line, its parts joined by '-' and its unique id last
+inline void dissolveMeds(std::string language, stringPool& words, postingStore& postings, medicineIndex& medIndex) {
+  // Open the input file
+  std::ifstream input(medsFileName(language));
+  if (!input.is_open()) {
+    std::cerr << "file \"" << medsFileName(language) << "\" could not open" << std::endl;
+    postings.freeze({}, words.size());
+    return;
+  }
+
+  // The (word, row) pairs, in the order of the rows, and the last row of each word
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  VI lastRow(words.size(), stringPool::npos);
+  unsigned medRow = 0;
+  for (std::string medicine; input >> medicine; medRow++) {
+    // Store the current medicine
+    medIndex.push_back(medicine);
+
+    // Split the current medicine (since we only have the reference to it)
+    std::vector<std::string> parts = splitUp(medicine, SplitMode::DE);
+    if (parts.empty())
+      continue;
+
+    // Do not consider the last part, since that is the unique id of the medicine.
+    // Filter out the parts which are way too small
+    for (unsigned index = 0, limit = parts.size() - 1; index != limit; ++index) {
+      if (parts[index].length() < MIN_LEN)
+        continue;
+      uint32_t word = words.intern(strToLower(parts[index]));
+      if (word == lastRow.size())
+        lastRow.push_back(stringPool::npos);
+      // It could be the case that a word occurs twice in the same medicine, e.g. "alfa"
+      if (lastRow[word] != medRow) {
+        lastRow[word] = medRow;
+        pairs.emplace_back(word, medRow);
+      }
+    }
+  }
+  input.close();
+  postings.freeze(pairs, words.size());
+}
+
+// Build up the metric tree, bulk-loaded on 'threadCount' threads (by default one per core) as if the words were inserted
+// in the order of their ids, thus the node ids of the tree are the word ids
+inline void buildStorage(const stringPool& words, metricTree& container, unsigned threadCount = std::thread::hardware_concurrency()) {
+  std::vector<std::string_view> keys(words.size());
+  for (uint32_t word = 0; word != words.size(); ++word)
+    keys[word] = words.at(word);
+  container = metricTree(keys, std::max(1u, threadCount));
+}
+
+// Build the index over the medicines from scratch, split up by 'dissolve(words, postings, medIndex)'
+template <typename Dissolve>
+void buildIndexOf(Dissolve&& dissolve, uint64_t sourceHash, medSnapshot& index, postingFormat format) {
+  // 'words' and 'postings' save the indexes in file for each part of medicine
+  stringPool words;
+  postingStore postings;
+
+  // 'medIndex' tells us which medicine is to be found at a certain index (row)
+  medicineIndex medIndex;
+
+  // Split up the medicines to which we translate
+  {
+    STATS_PHASE(dissolveMeds);
+    dissolve(words, postings, medIndex);
+  }
+
+  // Save the parts into a BK-Tree.
+  metricTree container;
+  {
+    STATS_PHASE(buildStorage);
+    buildStorage(words, container);
+  }
+
+  // And lay everything out in the snapshot
+  STATS_PHASE(buildSnapshot);
+  index.build(container.view(), postings, medIndex, medIndex.size(), sourceHash, MIN_LEN, format);
+}
+
+// Build the index over the medicines written in 'language' from scratch
+inline void buildIndex(const std::string& language, uint64_t sourceHash, medSnapshot& index, postingFormat format = postingFormat::plain) {
+  buildIndexOf([&language](stringPool& words, postingStore& postings, medicineIndex& medIndex) {
+    dissolveMeds(language, words, postings, medIndex);
+  }, sourceHash, index, format);
+}
+
+// Map the index over the medicines of 'sourceFileName' from 'indexFileName', if up-to-date, and build it with 'build(sourceHash, index)'
+// (and save it) otherwise. Without 'indexFileName', the index is only built in memory
+template <typename Build>
+void loadIndexOf(const std::string& sourceFileName, const std::string& indexFileName, medSnapshot& index, postingFormat format, Build&& build) {
+  uint64_t sourceHash = hashFile(sourceFileName);
+  bool opened = false;
+  if (!indexFileName.empty()) {
+    STATS_PHASE(openSnapshot);
+    opened = index.open(indexFileName, sourceHash, MIN_LEN, format);
+  }
+  if (!opened) {
+    build(sourceHash, index);
+    if ((!indexFileName.empty()) && (!index.save(indexFileName)))
+      std::cerr << "index \"" << indexFileName << "\" could not be written" << std::endl;
+  }
+}
+
+// Map the index over the medicines written in 'language' from 'indexFileName', if up-to-date, and build (and save) it otherwise
+inline void loadIndex(const std::string& language, const std::string& indexFileName, medSnapshot& index, postingFormat format = postingFormat::plain) {
+  loadIndexOf(medsFileName(language), indexFileName, index, format, [&language, format](uint64_t sourceHash, medSnapshot& index) {
+    buildIndex(language, sourceHash, index, format);
+  });
+}
+
+// Analyze the line and parse the common name along with its synonyms, which are not chemical formulas
+inline std::pair<std::string, std::pair<VS, VS>> analyzeLine(std::string_view line) {
+  // Check for empty line
+  if (line.empty()) {
+    std::vector<std::string> empty;
+    return make_pair(std::string(), make_pair(empty, empty));
+  }
+
+  // Lambda-expression to check if the current char is a paranthesis
+  // Words which contain at least a complex paranthesis are chemical formulas, thus, we are not interested in them
+  auto isComplexParanthesis = [](char c) -> bool {
+    return (c == '[') || (c == ']') || (c == '{') || (c == '}');
+  };
+  // There could be the case that a simple paranthesis only marks an explanation, e.g. Insuline (human)
+  auto isSimpleParanthesis = [](char c) -> bool {
+    return (c == '(') || (c == ')');
+  };
+
+  // Extract the common name
+  std::string commonName;
+  unsigned index = 0;
+  bool hadSimpleParanthesis = false, hadComplexParanthesis = false;
+  for (bool activate = false; index != line.size(); ++index) {
+    if (line[index] == '"') {
+      activate = !activate;
+    } else {
+      if ((!activate) && (line[index] == ','))
+        break;
+      hadSimpleParanthesis |= isSimpleParanthesis(line[index]);
+      hadComplexParanthesis |= isComplexParanthesis(line[index]);
+      commonName += line[index];
+    }
+  }
+  // If common name contained a complex paranthesis, that's for sure a chemical formula
+  if (hadComplexParanthesis) {
+    commonName.clear();
+  } else if (hadSimpleParanthesis) {
+    // Otherwise, it could be only an explanation, which is not that harmful
+    commonName = cleanUp(commonName);
+  }
+
+  // Can we deploy the result earlier?
+  std::vector<std::string> synonyms, prices;
+  if ((commonName.empty()) || (index == line.size()))
+    return make_pair(commonName, make_pair(synonyms, prices));
+
+  // Append an element (synonym or price) to its corresponding list, depending on 'beginOfPrices'
+  bool hasSimpleParanthesis = false, hasComplexParanthesis = false, beginOfPrices = false;
+  auto appendElem = [&synonyms, &prices, &hasSimpleParanthesis, &hasComplexParanthesis, &beginOfPrices](std::string& elem) -> void {
+    if (elem.empty())
+      return;
+    if (hasComplexParanthesis)
+      return;
+    if (hasSimpleParanthesis)
+      elem = cleanUp(elem);
+    if (beginOfPrices)
+      prices.push_back(trim(elem));
+    else
+      synonyms.push_back(trim(elem));
+    hasSimpleParanthesis = hasComplexParanthesis = false;
+    elem.clear();
+  };
+
+  std::string curr;
+  bool activate = false;
+  unsigned distance = 1;
+  for (++index; index != line.size(); ++index) {
+    if (line[index] == '"') {
+      activate = !activate;
+    } else {
+      // End of synonym?
+      if (line[index] == '|') {
+        appendElem(curr);
+        distance = 0;
+      } else {
+        // Update the word and its status
+        hasSimpleParanthesis |= isSimpleParanthesis(line[index]);
+        hasComplexParanthesis |= isComplexParanthesis(line[index]);
+
+        // If the medicine starts exactly after a bar, that is where the prices begin to appear
+        if ((!distance) && (line[index] != ' '))
+          beginOfPrices = true;
+        curr += line[index];
+        ++distance;
+      }
+    }
+  }
+  // And append the last synonym, only if did not contain any complex paranthesis
+  appendElem(curr);
+
+  // And deploy
+  return make_pair(commonName, make_pair(synonyms, prices));
+}
+
+// A name, lowercased and split into its parts
+struct parsedName {
+  std::string casted;
+  VS parts;
+};
+
+inline parsedName parseName(std::string_view name, SplitMode mode) {
+  parsedName ret;
+  ret.casted = foldToLower(name);
+  ret.parts = splitUp(ret.casted, mode);
+  return ret;
+}
+
+// A row of the Drugbank database, parsed and tokenized once, whichever indexes it is then matched against
+struct parsedRow {
+  std::string commonName;
+  parsedName common;
+  std::vector<parsedName> synonyms, prices;
+};
+
+// Call 'callback(part)' for each part of the names of 'row' which the matcher may search fuzzily: the single parts of the names,
+// and the parts of the longer names which are long enough and not only digits
+template <typename Callback>
+void forEachSearchedPart(const parsedRow& row, Callback&& callback) {
+  auto visit = [&callback](const parsedName& name) {
+    for (auto& part : name.parts)
+      if ((name.parts.size() == 1) || ((part.length() >= MIN_LEN) && (!hasOnlyDigits(part))))
+        callback(std::string_view(part));
+  };
+  visit(row.common);
+  for (auto& name : row.synonyms)
+    visit(name);
+  for (auto& name : row.prices)
+    visit(name);
+}
+
+// A row of the Drugbank database, as views into the file: the whole record (e.g. to fingerprint it), its common name and its synonyms,
+// along with its Drugbank id (only in the vocabulary). In en_meds.csv, the synonyms are followed by the prices, the first of which is sticked to its bar
+struct drugbankRecord {
+  std::string_view record, commonName, synonyms, id;
+  bool hasPrices = true;
+};
+
+// Reads the rows of the Drugbank database, either straight from its vocabulary (drugbank_vocabulary.csv, whose header names the columns)
+// or from en_meds.csv, flattened by the Python parser (the common name, then the synonyms and prices)
+class drugbankReader {
+  csvReader csv;
+  std::vector<std::string_view> fields;
+  size_t commonField = 0, synonymsField = 1, idField = 0;
+  bool vocabulary = false;
+
+  public:
+  bool open(const std::string& fileName) {
+    if (!csv.open(fileName))
+      return false;
+    std::string_view header;
+    vocabulary = false;
+    if (csv.next(fields, header)) {
+      auto common = std::find(fields.begin(), fields.end(), "Common name"), synonyms = std::find(fields.begin(), fields.end(), "Synonyms");
+      if ((common != fields.end()) && (synonyms != fields.end())) {
+        commonField = common - fields.begin();
+        synonymsField = synonyms - fields.begin();
+        idField = std::find(fields.begin(), fields.end(), "DrugBank ID") - fields.begin();
+        vocabulary = true;
+        return true;
+      }
+    }
+    csv.rewind();
+    return true;
+  }
+
+  bool next(drugbankRecord& row) {
+    if (!csv.next(fields, row.record))
+      return false;
+    if (vocabulary) {
+      row.commonName = (commonField < fields.size()) ? fields[commonField] : std::string_view();
+      row.synonyms = (synonymsField < fields.size()) ? fields[synonymsField] : std::string_view();
+      row.id = (idField < fields.size()) ? fields[idField] : std::string_view();
+      row.hasPrices = false;
+      return true;
+    }
+    splitFlattened(row);
+    return true;
+  }
+
+  // Split a line of en_meds.csv, already parsed into 'fields'. Everything after the common name are the synonyms and the prices,
+  // thus with more than two fields, the rest of the line is taken as it is
+  void splitFlattened(drugbankRecord& row) const {
+    row.hasPrices = true;
+    row.id = std::string_view();
+    row.commonName = fields.empty() ? std::string_view() : fields[0];
+    row.synonyms = std::string_view();
+    if (fields.size() == 2) {
+      row.synonyms = fields[1];
+    } else if (fields.size() > 2) {
+      size_t start = fields[1].data() - row.record.data();
+      if ((start) && (row.record[start - 1] == '"'))
+        --start;
+      row.synonyms = row.record.substr(start);
+    }
+  }
+
+  // A line of en_meds.csv as a row
+  drugbankRecord parseLine(std::string_view line) {
+    drugbankRecord row;
+    size_t pos = 0;
+    row.record = parseCsvRecord(line, pos, fields);
+    splitFlattened(row);
+    return row;
+  }
+};
+
+// Parse a row as 'analyzeLine' does, but right from the views of its fields: the common name, then the synonyms and the prices
+// (split at the bars), leaving out the chemical formulas (which contain brackets or braces) and the explanations in parentheses.
+// Only the names are copied, when lowercased and tokenized
+inline parsedRow parseRecord(const drugbankRecord& row) {
+  parsedRow ret;
+
+  // The quotes are dropped (copying the field, which is rare)
+  auto dropQuotes = [](std::string_view str, std::string& scratch) -> std::string_view {
+    if (str.find('"') == std::string_view::npos)
+      return str;
+    scratch.assign(str.begin(), str.end());
+    scratch.erase(std::remove(scratch.begin(), scratch.end(), '"'), scratch.end());
+    return scratch;
+  };
+  auto hasComplexParanthesis = [](std::string_view str) -> bool {
+    return str.find_first_of("[]{}") != std::string_view::npos;
+  };
+  auto hasSimpleParanthesis = [](std::string_view str) -> bool {
+    return str.find_first_of("()") != std::string_view::npos;
+  };
+
+  // Extract the common name
+  std::string scratch;
+  auto commonName = dropQuotes(row.commonName, scratch);
+  if (hasComplexParanthesis(commonName))
+    return ret;
+  ret.commonName = hasSimpleParanthesis(commonName) ? cleanUp(commonName) : std::string(commonName);
+  if (ret.commonName.empty())
+    return ret;
+  ret.common = parseName(ret.commonName, SplitMode::EN);
+
+  // And the synonyms, up to the first element sticked to its bar, where the prices begin
+  auto list = dropQuotes(row.synonyms, scratch);
+  bool beginOfPrices = false;
+  for (size_t begin = 0; begin <= list.size(); ) {
+    size_t end = std::min(list.find('|', begin), list.size());
+    auto elem = list.substr(begin, end - begin);
+    if ((row.hasPrices) && (begin) && (!elem.empty()) && (elem.front() != ' '))
+      beginOfPrices = true;
+    // A chemical formula ends the list (which is how 'analyzeLine' has always treated it)
+    if (hasComplexParanthesis(elem))
+      break;
+    if (!elem.empty()) {
+      auto& target = beginOfPrices ? ret.prices : ret.synonyms;
+      auto mode = beginOfPrices ? SplitMode::EN_PRICE : SplitMode::EN;
+      if (hasSimpleParanthesis(elem))
+        target.push_back(parseName(trim(cleanUp(elem)), mode));
+      else
+        target.push_back(parseName(ltrim(rtrim(elem)), mode));
+    }
+    begin = end + 1;
+  }
+  return ret;
+}
+
+// Parse a line of en_meds.csv
+inline parsedRow parseRow(std::string_view line) {
+  thread_local drugbankReader reader;
+  return parseRecord(reader.parseLine(line));
+}
+
+// Intern the words (of at least MIN_LEN chars) of the English medicines, those of the common name and of the synonyms of each row
+// of the Drugbank database (in either format), which is named by its common name: the index of the queries from the target languages
+inline void dissolveEnglish(const std::string& databankFileName, stringPool& words, postingStore& postings, medicineIndex& medIndex) {
+  drugbankReader in;
+  if (!in.open(databankFileName)) {
+    std::cerr << "file \"" << databankFileName << "\" could not open" << std::endl;
+    postings.freeze({}, words.size());
+    return;
+  }
+
+  // The (word, row) pairs, in the order of the rows, and the last row of each word (a word often recurs in the synonyms)
+  std::vector<std::pair<uint32_t, uint32_t>> pairs;
+  VI lastRow(words.size(), stringPool::npos);
+  drugbankRecord record;
+  for (uint32_t row = 0; in.next(record); ++row) {
+    parsedRow parsed = parseRecord(record);
+    medIndex.push_back(parsed.commonName);
+    auto addParts = [&](const parsedName& name) -> void {
+      for (auto& part : name.parts) {
+        if (part.length() < MIN_LEN)
+          continue;
+        uint32_t word = words.intern(part);
+        if (word == lastRow.size())
+          lastRow.push_back(stringPool::npos);
+        if (lastRow[word] != row) {
+          lastRow[word] = row;
+          pairs.emplace_back(word, row);
+        }
+      }
+    };
+    addParts(parsed.common);
+    for (auto& synonym : parsed.synonyms)
+      addParts(synonym);
+  }
+  postings.freeze(pairs, words.size());
+}
+
+// Map the index over the English medicines of 'databankFileName' from 'indexFileName', if up-to-date, and build (and save) it otherwise
+inline void loadEnglishIndex(const std::string& databankFileName, const std::string& indexFileName, medSnapshot& index,
+                             postingFormat format = postingFormat::plain) {
+  loadIndexOf(databankFileName, indexFileName, index, format, [&databankFileName, format](uint64_t sourceHash, medSnapshot& index) {
+    buildIndexOf([&databankFileName](stringPool& words, postingStore& postings, medicineIndex& medIndex) {
+      dissolveEnglish(databankFileName, words, postings, medIndex);
+    }, sourceHash, index, format);
+  });
+}
+
+// Dense accumulators over the rows of the medicines, reused across queries. Resetting them costs O(1):
+// the entries of a row are only valid if its stamp is the current epoch, and the rows touched in the current epoch
+// are listed (in the order in which they were first touched) for the final scan.
+// A second epoch marks the rows already seen for the current part
+class scoringWorkspace {
+  VI counts, closenesses, points, stamps, partStamps, touchedRows;
+  uint32_t epoch = 0, partEpoch = 0;
+
+  public:
+  void reserve(uint32_t rowCount) {
+    if (stamps.size() >= rowCount)
+      return;
+    counts.resize(rowCount);
+    closenesses.resize(rowCount);
+    points.resize(rowCount);
+    stamps.resize(rowCount, 0);
+    partStamps.resize(rowCount, 0);
+  }
+
+  // Start a new query
+  void reset(uint32_t rowCount) {
+    reserve(rowCount);
+    if (!++epoch) {
+      std::fill(stamps.begin(), stamps.end(), 0);
+      epoch = 1;
+    }
+    touchedRows.clear();
+  }
+
+  // Start a new part
+  void nextPart() {
+    if (!++partEpoch) {
+      std::fill(partStamps.begin(), partStamps.end(), 0);
+      partEpoch = 1;
+    }
+  }
+
+  // Whether 'row' has not yet appeared for the current part (and mark it)
+  bool firstInPart(uint32_t row) {
+    if (partStamps[row] == partEpoch)
+      return false;
+    partStamps[row] = partEpoch;
+    return true;
+  }
+
+  // Count 'row' once more, 'distance' away, and credit it with 'score' points (of the ranked matching)
+  void add(uint32_t row, uint32_t distance, uint32_t score = 0) {
+    if (stamps[row] != epoch) {
+      stamps[row] = epoch;
+      counts[row] = closenesses[row] = points[row] = 0;
+      touchedRows.push_back(row);
+    }
+    counts[row]++;
+    closenesses[row] += distance;
+    points[row] += score;
+  }
+
+  // Whether 'row' has been counted in the current query
+  bool touched(uint32_t row) const {
+    return stamps[row] == epoch;
+  }
+
+  uint32_t count(uint32_t row) const {
+    return counts[row];
+  }
+
+  uint32_t closeness(uint32_t row) const {
+    return closenesses[row];
+  }
+
+  uint32_t score(uint32_t row) const {
+    return points[row];
+  }
+
+  // Scan the touched rows in increasing order
+  void sortTouched() {
+    std::sort(touchedRows.begin(), touchedRows.end());
+  }
+
+  const VI& touched() const {
+    return touchedRows;
+  }
+};
+
+// Matches English medicines against the index of the medicines to which we translate.
+// A matcher keeps scratch buffers across queries, thus each thread should use its own (the index can be shared)
+class Matcher {
+  public:
+  // A matched row of the German list, for the query with id 'query' (its position in the batch)
+  struct result {
+    uint32_t query;
+    uint32_t row;
+    uint32_t score;
+  };
+
+  private:
+  const medSnapshot& index;
+  const medSnapshot::treeView& container;
+
+  // The fuzzy index answering the searches for similar parts instead of the BK-Tree, if any
+  const deletionIndex* deletions;
+
+  // The similar words of the parts of a whole input, joined at once against the vocabulary, if any (see 'useJoin')
+  const similarityJoin* joined = nullptr;
+
+  // The buffer into which the tree reports the similar parts
+  treeMatches devs;
+
+  // The scoring of the rows, along with the unique and the accepted parts and the best rows of the current query
+  scoringWorkspace scores;
+  std::vector<std::string_view> uniqueParts, acceptedParts;
+  scoredRows best;
+
+  // Scratch of the batches
+  std::vector<uint32_t> order;
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  scoredRows pending, rows;
+
+  // The words looked up in the index so far, if recorded (see 'recordProbes')
+  VS* probes = nullptr;
+
+  // Whether the BK-Tree is searched a frontier at a time (see 'searchFrontiers')
+  bool frontiers = false;
+
+  // The number of ranked rows to keep per query, 0 to keep all best rows (see 'rankTop')
+  uint32_t topK = 0;
+
+  // The accepted parts of the ranked matching, each with the words it reached (in 'partWords', closest first),
+  // its weight (its share of the lengths of all parts, after the soft-max) and the most points it can add to a row
+  struct rankedPart {
+    uint32_t first, last;
+    uint32_t weight, bound;
+  };
+  std::vector<rankedPart> rankedParts;
+  std::vector<std::pair<uint32_t, uint32_t>> partWords;
+  VI candidates, heap;
+
+  // The id of 'word' in the vocabulary, 'medSnapshot::npos' if not present
+  uint32_t lookup(std::string_view word) {
+    if (probes)
+      probes->emplace_back(word);
+    return index.find(word);
+  }
+
+  // Search for the parts similar to 'part', into 'devs'
+  void findSimilar(std::string_view part) {
+    if (probes)
+      probes->emplace_back(part);
+    devs.clear();
+    if ((joined) && (joined->find(devs, part)))
+      return;
+    if (deletions)
+      deletions->find_within(devs, part, SEARCH_PRECISION);
+    else if (frontiers)
+      container.find_within_frontier(devs, part, SEARCH_PRECISION);
+    else
+      container.find_within(devs, part, SEARCH_PRECISION);
+  }
+
+  void printIndex(const scoredRows& v) const {
+    for (auto [elem, closeness] : v) {
+      std::cout << "(" << elem << " -> " << index.medicine(elem) << "), ";
+    }
+    std::cout << std::endl;
+  }
+
+  // Score the rows of the medicines against the parts in 'splitted', into 'best'
+  const scoredRows& solveSplittedCase(const VS& splitted, std::string_view optional = std::string_view()) {
+    // Sum up the Levenshtein distances of the edges, and count how many times the index has been used
+    scores.reset(index.medicineCount());
+    best.clear();
+
+    // Pick only the unique parts in 'splitted'
+    uniqueParts.assign(splitted.begin(), splitted.end());
+    std::sort(uniqueParts.begin(), uniqueParts.end());
+    uniqueParts.erase(std::unique(uniqueParts.begin(), uniqueParts.end()), uniqueParts.end());
+
+    acceptedParts.clear();
+    rankedParts.clear();
+    partWords.clear();
+    for (auto part : uniqueParts) {
+      if (part.length() < MIN_LEN)
+        continue;
+      if (hasOnlyDigits(part))
+        continue;
+
+      // Check if the part can be directly found in the vocabulary
+      auto word = lookup(part);
+      if (topK) {
+        // The ranked matching first collects the words of all parts, and scores the rows when it knows the bounds of the parts
+        if (word == medSnapshot::npos) {
+          findSimilar(part);
+          if (devs.empty())
+            continue;
+        }
+        acceptedParts.push_back(part);
+        rankedParts.push_back({static_cast<uint32_t>(partWords.size()), 0, 0, 0});
+        if (word != medSnapshot::npos) {
+          partWords.emplace_back(word, 0);
+        } else {
+          for (auto dev : devs)
+            partWords.emplace_back(dev.node, dev.distance);
+          std::stable_sort(partWords.begin() + rankedParts.back().first, partWords.end(),
+                           [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.second < b.second; });
+        }
+        rankedParts.back().last = partWords.size();
+      } else if (word != medSnapshot::npos) {
+        // If so, the Levenshtein distance is 0, so only increase the count of the index
+        acceptedParts.push_back(part);
+        for (auto row : index.postings(word))
+          scores.add(row, 0);
+      } else {
+        // Search for similar parts
+        findSimilar(part);
+        if (!devs.empty()) {
+          acceptedParts.push_back(part);
+
+          // Each part, if not directly found in the vocabulary, can have many similar parts in the file
+          // Thus, we do not want to repeat an index, if it should appear at 2 different parts
+          scores.nextPart();
+          for (auto dev : devs) {
+            auto levDistance = dev.distance;
+
+            // And update with the indexes of the word
+            for (auto row : index.postings(dev.node)) {
+              // First check if the index has not yet appeared for 'part'
+              if (scores.firstInPart(row))
+                scores.add(row, levDistance);
+            }
+          }
+        }
+      }
+    }
+
+    // Custom function to determine how many times an index should appear
+    auto analyzeAcceptedParts = [&splitted, this]() -> uint32_t {
+      // The threshold for the soft-max function
+      static constexpr double threshold = 1.0 / exp(1);
+
+      // The lower-bound of the number of accepted parts
+      auto lowerBound = static_cast<uint32_t>(splitted.size() / 2);
+
+      // We are very restrictive
+      if ((splitted.size() % 2) or (splitted.size() == 2))
+        return lowerBound + 1;
+
+      // Compute the soft-max of the lengths
+      auto computeSoftMax = [&splitted, this]() -> double {
+        auto addExp = [](const auto& parts) -> double {
+          return std::accumulate(parts.begin(), parts.end(), 0, [](double acc, std::string_view part) {
+            return acc + exp(part.length());
+          });
+        };
+
+        // And return the ratio
+        return addExp(acceptedParts) / addExp(splitted);
+      };
+
+      // Compute the lower-bound, after having analyzed the lengths of the accepted parts
+      uint32_t offset = (acceptedParts.size() == lowerBound) ? (computeSoftMax() < threshold) : 1;
+      return lowerBound + offset;
+    };
+
+    // First check if the lower bound has been respected
+    auto currentAcceptedSize = analyzeAcceptedParts();
+    if (acceptedParts.size() < currentAcceptedSize)
+      return best;
+    if (topK)
+      return rankSplittedCase(splitted, currentAcceptedSize);
+
+    // And find the best indexes, where the medicines can be matched with the current medicine (its parts are in splitted).
+    // The rows are scanned in increasing order, thus the first medicine wins among equally scored ones
+    uint32_t maxIndexCount = 0, minCloseness = std::numeric_limits<uint32_t>::max();
+    scores.sortTouched();
+    for (auto row : scores.touched()) {
+      uint32_t count = scores.count(row);
+      if (count < currentAcceptedSize)
+        continue;
+      if (count > maxIndexCount) {
+        maxIndexCount = count;
+        minCloseness = scores.closeness(row);
+        best.clear();
+        best.emplace_back(row, minCloseness);
+      } else if ((count == maxIndexCount) && (scores.closeness(row) < minCloseness)) {
+        minCloseness = scores.closeness(row);
+        best.emplace_back(row, minCloseness);
+      }
+    }
+
+    // And return the best indexes
+    return best;
+  }
+
+  // Rank the rows reached by the accepted parts (collected into 'rankedParts'), into the 'topK' best of 'best'. A row scores,
+  // for each part, the weight of the part scaled down by the distance to it, and needs at least 'lowerBound' parts.
+  // The parts are scanned heaviest first, keeping the k-th best score in a bounded heap: once no row yet unseen
+  // can reach it (or the lower bound), the remaining parts only complete the scores of the rows still in the race,
+  // by looking them up in the posting lists, and the scan stops when none is left
+  const scoredRows& rankSplittedCase(const VS& splitted, uint32_t lowerBound) {
+    // The weights: the soft-max of the lengths, over all parts
+    double total = 0;
+    for (auto& part : splitted)
+      total += exp(part.length());
+    for (size_t pos = 0; pos != rankedParts.size(); ++pos) {
+      auto part = acceptedParts[pos];
+      double share = std::count(splitted.begin(), splitted.end(), part) * exp(part.length()) / total;
+      rankedParts[pos].weight = static_cast<uint32_t>(share * SCORE_SCALE);
+      rankedParts[pos].bound = pointsOf(rankedParts[pos], partWords[rankedParts[pos].first].second);
+    }
+    std::stable_sort(rankedParts.begin(), rankedParts.end(), [](const rankedPart& a, const rankedPart& b) { return a.bound > b.bound; });
+    uint64_t remainingBound = 0;
+    for (auto& part : rankedParts)
+      remainingBound += part.bound;
+
+    // The k-th best score among the rows which already qualify (their scores can only grow), 0 if there are less than k of them
+    auto kthScore = [this, lowerBound](const VI& rows) -> uint32_t {
+      heap.clear();
+      for (auto row : rows) {
+        if (scores.count(row) < lowerBound)
+          continue;
+        if (heap.size() < topK) {
+          heap.push_back(scores.score(row));
+          std::push_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+        } else if (scores.score(row) > heap.front()) {
+          std::pop_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+          heap.back() = scores.score(row);
+          std::push_heap(heap.begin(), heap.end(), std::greater<uint32_t>());
+        }
+      }
+      return (heap.size() == topK) ? heap.front() : 0;
+    };
+
+    bool open = true;
+    candidates.clear();
+    for (size_t pos = 0; pos != rankedParts.size(); ++pos) {
+      auto& part = rankedParts[pos];
+      remainingBound -= part.bound;
+      uint32_t remainingParts = rankedParts.size() - pos - 1;
+      scores.nextPart();
+      if (open) {
+        // The closest word of the part counts for a row
+        for (uint32_t w = part.first; w != part.last; ++w) {
+          auto [word, distance] = partWords[w];
+          uint32_t points = pointsOf(part, distance);
+          for (auto row : index.postings(word))
+            if (scores.firstInPart(row))
+              scores.add(row, distance, points);
+        }
+
+        // Can a row yet unseen still make it into the top k?
+        uint32_t threshold = kthScore(scores.touched());
+        if ((remainingParts < lowerBound) || ((threshold) && (threshold > remainingBound))) {
+          for (auto row : scores.touched())
+            if ((scores.count(row) + remainingParts >= lowerBound) && (scores.score(row) + remainingBound >= threshold))
+              candidates.push_back(row);
+          open = false;
+        }
+      } else {
+        for (auto row : candidates) {
+          for (uint32_t w = part.first; w != part.last; ++w) {
+            auto [word, distance] = partWords[w];
+            if (index.postings(word).contains(row)) {
+              scores.add(row, distance, pointsOf(part, distance));
+              break;
+            }
+          }
+        }
+        uint32_t threshold = kthScore(candidates);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t row) {
+          return (scores.count(row) + remainingParts < lowerBound) || (scores.score(row) + remainingBound < threshold);
+        }), candidates.end());
+      }
+      if ((!open) && (candidates.empty()))
+        break;
+    }
+
+    // The best rows, by decreasing score (then by row)
+    best.clear();
+    for (auto row : open ? scores.touched() : candidates)
+      if (scores.count(row) >= lowerBound)
+        best.emplace_back(row, scores.score(row));
+    keepTop(best, 0);
+    return best;
+  }
+
+  // The points of 'part' for a row reached 'distance' away
+  static uint32_t pointsOf(const rankedPart& part, uint32_t distance) {
+    return static_cast<uint64_t>(part.weight) * (SEARCH_PRECISION + 1 - distance) / (SEARCH_PRECISION + 1);
+  }
+
+  // The score of a row reached through a single part, 'distance' away: its closeness, or its points in the ranked matching
+  uint32_t rated(uint32_t distance) const {
+    return topK ? pointsOf({0, 0, SCORE_SCALE, 0}, distance) : distance;
+  }
+
+  // Sort the ranked rows of 'rows' from 'first' on by decreasing score (then by row), and keep the 'topK' first
+  void keepTop(scoredRows& rows, size_t first) const {
+    if (!topK)
+      return;
+    auto better = [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+      return (a.second != b.second) ? (a.second > b.second) : (a.first < b.first);
+    };
+    size_t keep = std::min<size_t>(topK, rows.size() - first);
+    std::partial_sort(rows.begin() + first, rows.begin() + first + keep, rows.end(), better);
+    rows.resize(first + keep);
+  }
+
+  // Add the rows of 'word', 'distance' away (only the first k when ranked: the rows are increasing, thus the best of equal scores)
+  void addPostings(uint32_t word, uint32_t distance, scoredRows& rows) {
+    uint32_t added = 0;
+    for (auto row : index.postings(word)) {
+      rows.emplace_back(row, rated(distance));
+      if (++added == topK)
+        break;
+    }
+  }
+
+  // Add the rows of the words similar to 'single', each row only once and in increasing order
+  // (thus independent of the shape of the fuzzy index, e.g. whether words have been added to the tree later on).
+  // When ranked, the closest words come first, and only the first k rows of a word can be among the best
+  bool matchSimilar(std::string_view single, scoredRows& rows) {
+    findSimilar(single);
+    if (devs.empty())
+      return false;
+    scores.reserve(index.medicineCount());
+    scores.nextPart();
+    size_t first = rows.size();
+    if (topK) {
+      std::stable_sort(devs.begin(), devs.end(), [](const metricTree::match& a, const metricTree::match& b) { return a.distance < b.distance; });
+      for (size_t pos = 0; pos != devs.size(); ++pos) {
+        if ((pos) && (devs[pos].distance != devs[pos - 1].distance) && (rows.size() - first >= topK))
+          break;
+        uint32_t seen = 0;
+        for (auto row : index.postings(devs[pos].node)) {
+          if (scores.firstInPart(row))
+            rows.emplace_back(row, rated(devs[pos].distance));
+          if (++seen == topK)
+            break;
+        }
+      }
+      keepTop(rows, first);
+      return true;
+    }
+    for (auto part : devs)
+      for (auto row : index.postings(part.node))
+        if (scores.firstInPart(row))
+          rows.emplace_back(row, part.distance);
+    std::sort(rows.begin() + first, rows.end());
+    return true;
+  }
+
+  // Analyze a type of list, either synonyms or prices
+  bool matchResemblances(const std::string& commonName, const std::vector<parsedName>& list, const std::string& resemblanceType, scoredRows& rows) {
+    static constexpr bool resemblanceListSolved = true;
+    if (list.empty())
+      return !resemblanceListSolved;
+
+    // Check the list
+    for (auto& elem : list) {
+      auto& splittedElem = elem.parts;
+      if (splittedElem.empty())
+        continue;
+
+      // If 'elem' consists of only one part
+      if (splittedElem.size() == 1) {
+        // Check if 'single' (already lowercased) can be directly found
+        auto& single = splittedElem.front();
+        auto word = lookup(single);
+        if (word != medSnapshot::npos) {
+          addPostings(word, 0, rows);
+#ifdef DEBUG
+          std::cout << "en (" << resemblanceType << ") de: " << commonName << " -> " << single << std::endl;
+#endif
+          return resemblanceListSolved;
+        } else if (matchSimilar(single, rows)) {
+#ifdef DEBUG
+          std::cout << "Found in list " << single << ": ";
+          for (auto part : devs)
+            std::cout << "commonName=" << commonName << " -> " << container.key(part.node) << ", ";
+          std::cout << std::endl;
+#endif
+          return resemblanceListSolved;
+        }
+      } else {
+        // Analyze 'elem' when there are many more parts
+        const scoredRows& bestIndexes = solveSplittedCase(splittedElem, elem.casted);
+        if (!bestIndexes.empty()) {
+          rows.insert(rows.end(), bestIndexes.begin(), bestIndexes.end());
+#ifdef DEBUG
+          std::cout << "*** Multiple : common=" << commonName << " " << resemblanceType << "=" << elem.casted;
+          printIndex(bestIndexes);
+#endif
+          return resemblanceListSolved;
+        }
+      }
+    }
+    return !resemblanceListSolved;
+  }
+
+  // Match the queries of a batch in sorted order, so that equal and similar queries hit warm caches (and equal ones are solved once),
+  // and hand out their results in the order of the queries. 'solve(query, rows)' matches the query with id 'query'
+  template <typename Solve>
+  void matchBatch(const std::string_view* queries, size_t count, std::vector<result>& results, Solve&& solve) {
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [queries](uint32_t a, uint32_t b) { return queries[a] < queries[b]; });
+
+    // 'ranges[query]' is the range of its results in 'pending'
+    pending.clear();
+    ranges.resize(count);
+    for (size_t pos = 0; pos != count; ++pos) {
+      uint32_t query = order[pos];
+      if ((pos) && (queries[query] == queries[order[pos - 1]])) {
+        ranges[query] = ranges[order[pos - 1]];
+        continue;
+      }
+      rows.clear();
+      solve(query, rows);
+      ranges[query] = std::make_pair(pending.size(), pending.size() + rows.size());
+      pending.insert(pending.end(), rows.begin(), rows.end());
+    }
+
+    for (uint32_t query = 0; query != count; ++query)
+      for (uint32_t pos = ranges[query].first; pos != ranges[query].second; ++pos)
+        results.push_back({query, pending[pos].first, pending[pos].second});
+  }
+
+  public:
+  explicit Matcher(const medSnapshot& index, const deletionIndex* deletions = nullptr) : index(index), container(index.tree()), deletions(deletions) { }
+
+  const medSnapshot& medicines() const {
+    return index;
+  }
+
+  // Record the words looked up in the index, exactly or fuzzily, into 'log' (nullptr to stop): the matching of a query
+  // only depends on the posting lists of the words within SEARCH_PRECISION of these
+  void recordProbes(VS* log) {
+    probes = log;
+  }
+
+  // Rank the matched rows of each query and keep the 'k' best of them, scored in millionths by the parts they contain,
+  // their closeness and the lengths of the parts (0, the default, keeps all the best rows, along with their closeness)
+  void rankTop(uint32_t k) {
+    topK = k;
+  }
+
+  uint32_t ranked() const {
+    return topK;
+  }
+
+  // Search the BK-Tree a frontier of nodes at a time, with the distances of several nodes computed at once (the same matching;
+  // only used without a deletion index)
+  void searchFrontiers(bool enabled) {
+    frontiers = enabled;
+  }
+
+  // Read the similar words of the parts from 'join' (nullptr to stop), the parts it has not joined being still searched
+  // in the fuzzy index (the same matching: the join reports the words of the fuzzy index, in the same order)
+  void useJoin(const similarityJoin* join) {
+    joined = join;
+  }
+
+  // Match a name (e.g. the common name) of a medicine. Returns whether the name is solved, in which case 'rows' holds its matching (if any)
+  bool matchName(std::string_view name, scoredRows& rows) {
+    return matchName(name, parseName(name, SplitMode::EN), rows);
+  }
+
+  // The same, with the name already parsed (as 'parsed')
+  bool matchName(std::string_view name, const parsedName& parsed, scoredRows& rows) {
+    // Check if the medicine has the same name in the other language
+    static constexpr bool nameSolved = true;
+    auto word = lookup(parsed.casted);
+
+    // Is the medicine similar in German?
+    if (word != medSnapshot::npos) {
+      addPostings(word, 0, rows);
+#ifdef DEBUG
+      std::cout << "en = de: " << name << std::endl;
+#endif
+      return nameSolved;
+    }
+
+    // Find possible deviations from the name
+    auto& splittedName = parsed.parts;
+    if (splittedName.empty())
+      return nameSolved;
+
+    if (splittedName.size() == 1) {
+      auto& single = splittedName.front();
+      word = lookup(single);
+      if (word != medSnapshot::npos) {
+        addPostings(word, 0, rows);
+#ifdef DEBUG
+        std::cout << "en ~ de: " << name << std::endl;
+#endif
+        return nameSolved;
+      }
+      if (matchSimilar(single, rows)) {
+#ifdef DEBUG
+        std::cout << "Deviated: " << name << ": ";
+        for (auto part : devs)
+          std::cout << "part=" << container.key(part.node) << ", ";
+        std::cout << std::endl;
+#endif
+        return nameSolved;
+      }
+    } else {
+      const scoredRows& bestIndexes = solveSplittedCase(splittedName, name);
+      if (!bestIndexes.empty()) {
+        rows.insert(rows.end(), bestIndexes.begin(), bestIndexes.end());
+#ifdef DEBUG
+        std::cout << "%%%: " << name;
+        printIndex(bestIndexes);
+#endif
+        return nameSolved;
+      }
+    }
+    return !nameSolved;
+  }
+
+  // Match a row of the Drugbank database (en_meds.csv): its common name, or else its synonyms, or else its prices
+  void matchRow(std::string_view line, scoredRows& rows) {
+    STATS_ROW(line);
+    matchRow(parseRow(line), rows);
+  }
+
+  // The same, with the row already parsed (e.g. once for the indexes of all languages)
+  void matchRow(const parsedRow& row, scoredRows& rows) {
+    // Check for an empty common nome
+    if (row.commonName.empty())
+      return;
+
+    {
+      STATS_PATH(commonName);
+      if (matchName(row.commonName, row.common, rows))
+        return;
+    }
+
+    // Analyze the synonyms
+    {
+      STATS_PATH(synonyms);
+      if (matchResemblances(row.commonName, row.synonyms, "synonym", rows))
+        return;
+    }
+
+    // Analyze the prices
+    STATS_PATH(prices);
+    matchResemblances(row.commonName, row.prices, "price", rows);
+  }
+
+  // Batched versions: append the matched rows of 'queries[0 .. count)' to 'results', grouped by query in increasing order
+  void matchNames(const std::string_view* queries, size_t count, std::vector<result>& results) {
+    matchBatch(queries, count, results, [this, queries](uint32_t query, scoredRows& rows) { matchName(queries[query], rows); });
+  }
+
+  void matchRows(const std::string_view* lines, size_t count, std::vector<result>& results) {
+    matchBatch(lines, count, results, [this, lines](uint32_t query, scoredRows& rows) { matchRow(lines[query], rows); });
+  }
+
+  // The same, with the rows already parsed into 'parsed[0 .. count)' (the lines still order the batch)
+  void matchRows(const std::string_view* lines, const parsedRow* parsed, size_t count, std::vector<result>& results) {
+    matchBatch(lines, count, results, [this, lines, parsed](uint32_t query, scoredRows& rows) {
+      STATS_ROW(lines[query]);
+      matchRow(parsed[query], rows);
+    });
+  }
+};
+
+#endif /* _MATCHER_HPP_ */
@@ -0,0 +1,72 @@
+#ifndef _PARALLEL_HPP_
+#define _PARALLEL_HPP_
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <condition_variable>
+
+// Run 'work(batch, worker)' for each batch in [0, batchCount) on 'threadCount' worker threads, while the calling thread
+// hands the finished batches to 'consume(batch)' in increasing order (the reorder stage).
+// Batch 'b' is initially queued at worker 'b % threadCount', so that the workers advance roughly in order;
+// a worker pops its own batches from the front and, once it runs dry, steals from the back of the others.
+template <typename Work, typename Consume>
+void runOrdered(unsigned threadCount, uint32_t batchCount, Work&& work, Consume&& consume) {
+  struct workerQueue {
+    std::mutex lock;
+    std::deque<uint32_t> batches;
+  };
+  std::vector<workerQueue> queues(threadCount);
+  for (uint32_t batch = 0; batch != batchCount; ++batch)
+    queues[batch % threadCount].batches.push_back(batch);
+
+  // Which batches are done
+  std::mutex doneLock;
+  std::condition_variable doneSignal;
+  std::vector<char> done(batchCount, false);
+
+  // Take the next batch of 'worker', from its own queue or stolen from another one
+  auto next = [&queues, threadCount](unsigned worker, uint32_t& batch) -> bool {
+    for (unsigned offset = 0; offset != threadCount; ++offset) {
+      auto& queue = queues[(worker + offset) % threadCount];
+      std::lock_guard<std::mutex> guard(queue.lock);
+      if (queue.batches.empty())
+        continue;
+      if (!offset) {
+        batch = queue.batches.front();
+        queue.batches.pop_front();
+      } else {
+        batch = queue.batches.back();
+        queue.batches.pop_back();
+      }
+      return true;
+    }
+    return false;
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned worker = 0; worker != threadCount; ++worker) {
+    workers.emplace_back([&, worker]() {
+      for (uint32_t batch; next(worker, batch); ) {
+        work(batch, worker);
+        std::lock_guard<std::mutex> guard(doneLock);
+        done[batch] = true;
+        doneSignal.notify_one();
+      }
+    });
+  }
+
+  // The reorder stage
+  for (uint32_t batch = 0; batch != batchCount; ++batch) {
+    std::unique_lock<std::mutex> guard(doneLock);
+    doneSignal.wait(guard, [&done, batch]() { return done[batch]; });
+    guard.unlock();
+    consume(batch);
+  }
+  for (auto& worker : workers)
+    worker.join();
+}
+
+#endif /* _PARALLEL_HPP_ */
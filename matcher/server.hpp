@@ -0,0 +1,130 @@
+#ifndef _SERVER_HPP_
+#define _SERVER_HPP_
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+
+// The longest request line, beyond which the client is answered with an error and hung up on
+#ifndef MAX_REQUEST_LENGTH
+#define MAX_REQUEST_LENGTH 65536
+#endif
+
+// The most clients served at once, the others being answered with an error and hung up on
+#ifndef MAX_CLIENTS
+#define MAX_CLIENTS 64
+#endif
+
+// The pause before accepting clients again, when the process has run out of descriptors or memory
+#ifndef ACCEPT_BACKOFF_MS
+#define ACCEPT_BACKOFF_MS 100
+#endif
+
+// Send all of 'data' to 'fd'
+inline bool sendAll(int fd, const std::string& data) {
+  for (size_t sent = 0; sent != data.size(); ) {
+    ssize_t count = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    sent += count;
+  }
+  return true;
+}
+
+// Answer the line-delimited requests of a client, until it hangs up or sends a line longer than MAX_REQUEST_LENGTH
+template <typename Answer>
+void serveClient(int fd, Answer& answer) {
+  std::string pending, response;
+  char buffer[4096];
+  for (bool tooLong = false; !tooLong; ) {
+    ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;
+    pending.append(buffer, count);
+
+    // Answer all complete lines at once
+    size_t begin = 0;
+    response.clear();
+    for (size_t end; (end = pending.find('\n', begin)) != std::string::npos; begin = end + 1) {
+      if (end - begin > MAX_REQUEST_LENGTH) {
+        tooLong = true;
+        break;
+      }
+      std::string request = pending.substr(begin, end - begin);
+      if (!request.empty() && request.back() == '\r')
+        request.pop_back();
+      answer(request, response);
+    }
+    pending.erase(0, begin);
+    // The rest of the line is not buffered beyond the limit
+    if ((tooLong) || (pending.size() > MAX_REQUEST_LENGTH)) {
+      tooLong = true;
+      response += "error: request too long\n\n";
+    }
+    if (!sendAll(fd, response))
+      break;
+  }
+  close(fd);
+}
+
+// Listen on the Unix domain socket 'path' and serve each client on its own thread (at most MAX_CLIENTS at once), with 'answer(request, response)'
+// appending the response to a request line (which has to be thread-safe). Only returns if the socket could not be set up,
+// or on an error of 'accept' which is not transient
+template <typename Answer>
+bool serveUnixSocket(const std::string& path, Answer&& answer) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+  memcpy(address.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return false;
+  unlink(path.c_str());
+  if ((bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) || (listen(fd, SOMAXCONN) != 0)) {
+    close(fd);
+    return false;
+  }
+
+  // Static, as the detached threads may outlive this function
+  static std::atomic<unsigned> clientCount(0);
+  for (;;) {
+    int client = accept(fd, nullptr, nullptr);
+    if (client < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
+        continue;
+      // Out of descriptors or memory for now (e.g. under load): wait for clients to hang up, and retry
+      if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_BACKOFF_MS));
+        continue;
+      }
+      close(fd);
+      return false;
+    }
+    if (clientCount.fetch_add(1) >= MAX_CLIENTS) {
+      --clientCount;
+      sendAll(client, "error: too many clients\n\n");
+      close(client);
+      continue;
+    }
+    std::thread([client, &answer]() {
+      serveClient(client, answer);
+      --clientCount;
+    }).detach();
+  }
+}
+
+#endif /* _SERVER_HPP_ */
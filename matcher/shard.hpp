@@ -0,0 +1,120 @@
+#ifndef _SHARD_HPP_
+#define _SHARD_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <unistd.h>
+#include "snapshot.hpp"
+
+// Sharded matching, to spread the rows of the database file over several processes (or machines):
+// - each process matches the rows of its shard and writes them into its own output, "<output>.<i>-of-<n>",
+//   each line under the index of its row in the whole database file (written under a temporary name and renamed once complete,
+//   thus a shard process killed midway leaves no output, which the merge then reports missing),
+// - the merge interleaves the lines of all shards by their rows, which gives the very output of a single process.
+
+// The shard 'index' of 'count': either a range of consecutive rows, or the rows whose fingerprint falls into it
+struct shardSpec {
+  uint32_t index = 0, count = 1;
+  bool byHash = false;
+
+  // Parse "<i>/<n>" (by row range) or "<i>/<n>:hash" (by the fingerprint of the row). Returns false if malformed
+  bool parse(std::string_view spec) {
+    std::string text(spec);
+    char* end;
+    unsigned long i = strtoul(text.c_str(), &end, 10);
+    if ((end == text.c_str()) || (*end != '/'))
+      return false;
+    const char* countStart = end + 1;
+    unsigned long n = strtoul(countStart, &end, 10);
+    if ((end == countStart) || (!n) || (i >= n) || (n > UINT32_MAX))
+      return false;
+    if (*end == ':') {
+      if (std::string_view(end + 1) != "hash")
+        return false;
+      byHash = true;
+    } else if (*end) {
+      return false;
+    }
+    index = i;
+    count = n;
+    return true;
+  }
+
+  // Whether the row at 'row' of the 'rowCount' rows, whose record is 'record', belongs to the shard
+  bool contains(uint32_t row, uint32_t rowCount, std::string_view record) const {
+    if (byHash)
+      return fnv1a(record.data(), record.size()) % count == index;
+    return (row >= uint64_t(rowCount) * index / count) && (row < uint64_t(rowCount) * (index + 1) / count);
+  }
+
+  // The output of the shard, for the output 'fileName' of a single process
+  std::string fileName(const std::string& outputFileName) const {
+    return outputFileName + "." + std::to_string(index) + "-of-" + std::to_string(count);
+  }
+};
+
+// Merge the outputs of the 'count' shards of 'fileName' into 'fileName'. The lines of each shard are in increasing rows,
+// thus taking the smallest row among the shards line by line gives the output of a single process.
+// Fails if a shard is missing (e.g. not complete yet) or if a row shows up twice (e.g. shards of different specs)
+inline bool mergeShards(const std::string& fileName, uint32_t count) {
+  std::vector<std::ifstream> inputs;
+  for (uint32_t index = 0; index != count; ++index) {
+    shardSpec shard;
+    shard.index = index;
+    shard.count = count;
+    inputs.emplace_back(shard.fileName(fileName));
+    if (!inputs.back().is_open()) {
+      std::cerr << "shard \"" << shard.fileName(fileName) << "\" could not open" << std::endl;
+      return false;
+    }
+  }
+
+  // The next line of each shard, by its row
+  std::vector<std::string> lines(count);
+  typedef std::pair<uint64_t, uint32_t> head;
+  std::priority_queue<head, std::vector<head>, std::greater<head>> heads;
+  auto advance = [&](uint32_t shard) -> void {
+    if (std::getline(inputs[shard], lines[shard]))
+      heads.push({strtoull(lines[shard].c_str(), nullptr, 10), shard});
+  };
+  for (uint32_t shard = 0; shard != count; ++shard)
+    advance(shard);
+
+  // Unique to the process, as the outputs of the shards are
+  std::string tempFileName = fileName + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream output(tempFileName, std::ios::trunc);
+    for (uint64_t previous = 0, written = 0; !heads.empty(); ++written) {
+      auto [row, shard] = heads.top();
+      heads.pop();
+      if ((written) && (row <= previous)) {
+        std::cerr << "row " << row << " is out of order in the shards of \"" << fileName << "\"" << std::endl;
+        output.close();
+        remove(tempFileName.c_str());
+        return false;
+      }
+      output << lines[shard] << '\n';
+      previous = row;
+      advance(shard);
+    }
+    if (!output) {
+      output.close();
+      remove(tempFileName.c_str());
+      return false;
+    }
+  }
+  if (rename(tempFileName.c_str(), fileName.c_str())) {
+    remove(tempFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+#endif /* _SHARD_HPP_ */
@@ -0,0 +1,296 @@
+/*
+ * Similarity join: the distinct keys of a whole input joined at once against the keys of a flat BK-tree, for small radii
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMILARITY_JOIN_HPP_
+#define _SIMILARITY_JOIN_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <thread>
+#include "flat_bk_tree.hpp"
+#include "deletion_index.hpp"
+
+namespace storage {
+
+namespace detail {
+
+/* FNV-1a of the segment 'index' of a key of length 'length', whose chars are 'chars' */
+inline uint64_t segment_hash(uint32_t length, uint32_t index, std::string_view chars) {
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](uint8_t byte) {
+		hash ^= byte;
+		hash *= 1099511628211ull;
+	};
+	for (unsigned shift = 0; shift != 32; shift += 8)
+		mix(static_cast<uint8_t>(length >> shift));
+	mix(static_cast<uint8_t>(index));
+	for (char c : chars)
+		mix(static_cast<uint8_t>(c));
+	return hash;
+}
+
+/* the start of the segment 'index' of a key of length 'length' split into 'count' segments (the last 'length % count' ones a char longer) */
+inline uint32_t segment_start(uint32_t length, uint32_t count, uint32_t index) {
+	uint32_t base = length / count, shorter = count - length % count;
+	return index * base + (index > shorter ? index - shorter : 0);
+}
+
+} /* namespace detail */
+
+/*
+ * Pass-join: a key split into d + 1 segments keeps one of them untouched by d edits, and any key within distance 'd' contains
+ * that segment, shifted by at most 'd' chars. The keys of the tree are indexed by their segments (along with their length and
+ * position), then 'join' takes the distinct keys of a whole input and probes, for each of them, only its substrings at the positions
+ * where such a segment can reappear (the multi-match-aware windows), verifying the candidates with 'Distance'.
+ * The matches of all keys form one table, thus an input costs one probe per distinct key rather than one per occurrence.
+ *
+ * 'find' reports the matches in the same order as 'flat_bktree_view::find_within' (the pre-order of the tree), as the deletion index does.
+ */
+template <
+	typename MetricType,
+	typename Distance
+>
+class similarity_join
+{
+public:
+	typedef flat_bktree_view<MetricType, Distance> view_type;
+	typedef typename view_type::node_id node_id;
+	typedef typename view_type::match match;
+
+private:
+	view_type m_tree;
+	MetricType m_distance = 0;
+
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	/* the distinct hashes of the segments, with the nodes having each of them in m_nodes[m_segment_offsets[h] .. m_segment_offsets[h + 1]) */
+	std::vector<uint64_t> m_hashes;
+	std::vector<uint32_t> m_segment_offsets;
+	std::vector<node_id> m_nodes;
+	uint32_t m_max_length = 0;
+
+	/* open addressing over 'm_hashes' */
+	std::vector<uint32_t> m_slots;
+	uint64_t m_mask = 0;
+
+	/* the position of each node in the pre-order of the tree */
+	std::vector<uint32_t> m_rank;
+
+	/* the joined keys, sorted, the key 'k' being m_chars[m_key_offsets[k] .. m_key_offsets[k + 1]),
+	 * with its matches in m_matches[m_offsets[k] .. m_offsets[k + 1]) */
+	std::string m_chars;
+	std::vector<uint32_t> m_key_offsets = {0};
+	std::vector<uint32_t> m_offsets = {0};
+	std::vector<match> m_matches;
+
+	/* the nodes having a segment with hash 'hash' */
+	std::pair<const node_id *, const node_id *> segment_nodes(uint64_t hash) const {
+		for (uint64_t slot = hash & m_mask; m_slots[slot] != npos; slot = (slot + 1) & m_mask) {
+			uint32_t h = m_slots[slot];
+			if (m_hashes[h] == hash)
+				return std::make_pair(m_nodes.data() + m_segment_offsets[h], m_nodes.data() + m_segment_offsets[h + 1]);
+		}
+		return std::make_pair(m_nodes.data(), m_nodes.data());
+	}
+
+	std::string_view joined_key(size_t k) const {
+		return std::string_view(m_chars).substr(m_key_offsets[k], m_key_offsets[k + 1] - m_key_offsets[k]);
+	}
+
+	/* append the matches of 'key' to 'result', in the pre-order of the tree */
+	void probe(std::vector<match> &result, std::string_view key) const {
+		if (m_slots.empty())
+			return;
+		STATS_QUERY_BEGIN();
+		const size_t first = result.size();
+		const int64_t d = m_distance, length = key.size();
+		const uint32_t count = m_distance + 1;
+		for (int64_t other = std::max<int64_t>(length - d, 0); other <= std::min<int64_t>(length + d, m_max_length); ++other) {
+			const int64_t shift = length - other;
+			for (uint32_t i = 0; i != count; ++i) {
+				const int64_t start = detail::segment_start(other, count, i);
+				const int64_t size = detail::segment_start(other, count, i + 1) - start;
+
+				/* the segment moves by at most 'i' chars because of the edits before it, and by at most 'd - i' because of those after it */
+				const int64_t lo = std::max<int64_t>({start - i, start + shift - (d - i), 0});
+				const int64_t hi = std::min<int64_t>({start + i, start + shift + (d - i), length - size});
+				for (int64_t pos = lo; pos <= hi; ++pos) {
+					auto range = segment_nodes(detail::segment_hash(other, i, key.substr(pos, size)));
+					for (; range.first != range.second; ++range.first)
+						result.push_back({*range.first, 0});
+				}
+			}
+		}
+
+		auto by_node = [](const match &a, const match &b) { return a.node < b.node; };
+		std::sort(result.begin() + first, result.end(), by_node);
+		result.erase(std::unique(result.begin() + first, result.end(),
+			[](const match &a, const match &b) { return a.node == b.node; }), result.end());
+
+		Distance f;
+		size_t kept = first;
+		for (size_t i = first; i != result.size(); ++i) {
+			MetricType n;
+			STATS_COUNT(candidates);
+			STATS_COUNT(distancesComputed);
+			if constexpr (detail::is_bounded_distance<std::string_view, MetricType, Distance>::value)
+				n = f(key, m_tree.key(result[i].node), m_distance);
+			else
+				n = f(key, m_tree.key(result[i].node));
+			if (n <= m_distance)
+				result[kept++] = {result[i].node, n};
+		}
+		result.resize(kept);
+
+		std::sort(result.begin() + first, result.end(),
+			[this](const match &a, const match &b) { return m_rank[a.node] < m_rank[b.node]; });
+		STATS_QUERY_END();
+	}
+
+public:
+	similarity_join() { }
+
+	/* index the keys of 'tree' by their segments, for joins with the radius 'distance' */
+	explicit similarity_join(const view_type &tree, MetricType distance = 1) {
+		build(tree, distance);
+	}
+
+	void build(const view_type &tree, MetricType distance = 1) {
+		m_tree = tree;
+		m_distance = distance;
+		m_max_length = 0;
+		const uint32_t count = distance + 1;
+		std::vector<std::pair<uint64_t, node_id>> segments;
+		for (node_id id = 0; id != tree.size(); ++id) {
+			/* the tombstones of erased keys only route the searches of the tree */
+			if (tree.erased(id))
+				continue;
+			std::string_view key = tree.key(id);
+			m_max_length = std::max<uint32_t>(m_max_length, key.size());
+			for (uint32_t i = 0; i != count; ++i) {
+				uint32_t start = detail::segment_start(key.size(), count, i);
+				segments.emplace_back(detail::segment_hash(key.size(), i, key.substr(start, detail::segment_start(key.size(), count, i + 1) - start)), id);
+			}
+		}
+		std::sort(segments.begin(), segments.end());
+		segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+
+		m_hashes.clear();
+		m_segment_offsets.clear();
+		m_nodes.clear();
+		m_nodes.reserve(segments.size());
+		for (size_t i = 0; i != segments.size(); ++i) {
+			if (!i || segments[i].first != segments[i - 1].first) {
+				m_hashes.push_back(segments[i].first);
+				m_segment_offsets.push_back(m_nodes.size());
+			}
+			m_nodes.push_back(segments[i].second);
+		}
+		m_segment_offsets.push_back(m_nodes.size());
+
+		uint64_t n_slots = 1;
+		while (n_slots < 2 * uint64_t(m_hashes.size()))
+			n_slots <<= 1;
+		m_mask = n_slots - 1;
+		m_slots.assign(n_slots, npos);
+		for (uint32_t h = 0; h != m_hashes.size(); ++h) {
+			uint64_t slot = m_hashes[h] & m_mask;
+			while (m_slots[slot] != npos)
+				slot = (slot + 1) & m_mask;
+			m_slots[slot] = h;
+		}
+		detail::pre_order_ranks(tree, m_rank);
+
+		m_chars.clear();
+		m_key_offsets.assign(1, 0);
+		m_offsets.assign(1, 0);
+		m_matches.clear();
+	}
+
+	/* join the distinct ones of 'keys' (in any order, with duplicates) against the keys of the tree, on 'thread_count' threads,
+	 * replacing the previous join */
+	void join(std::vector<std::string_view> keys, unsigned thread_count = 1) {
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+		m_chars.clear();
+		m_key_offsets.assign(1, 0);
+		for (auto key : keys) {
+			m_chars += key;
+			m_key_offsets.push_back(m_chars.size());
+		}
+
+		/* each thread joins a range of consecutive keys, the ranges being concatenated in order */
+		thread_count = std::max<size_t>(1, std::min<size_t>(thread_count, keys.size()));
+		std::vector<std::vector<match>> matches(thread_count);
+		std::vector<std::vector<uint32_t>> counts(thread_count);
+		auto work = [&](unsigned t) {
+			size_t first = keys.size() * t / thread_count, last = keys.size() * (t + 1) / thread_count;
+			for (size_t k = first; k != last; ++k) {
+				size_t before = matches[t].size();
+				probe(matches[t], keys[k]);
+				counts[t].push_back(matches[t].size() - before);
+			}
+		};
+		std::vector<std::thread> workers;
+		for (unsigned t = 1; t < thread_count; ++t)
+			workers.emplace_back(work, t);
+		work(0);
+		for (auto &worker : workers)
+			worker.join();
+
+		m_offsets.assign(1, 0);
+		m_matches.clear();
+		for (unsigned t = 0; t != thread_count; ++t) {
+			for (auto n : counts[t])
+				m_offsets.push_back(m_offsets.back() + n);
+			m_matches.insert(m_matches.end(), matches[t].begin(), matches[t].end());
+		}
+	}
+
+	/* append the matches of 'key' to 'result' and return true, if 'key' has been joined (false otherwise) */
+	bool find(std::vector<match> &result, std::string_view key) const {
+		size_t lo = 0, hi = joined();
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (joined_key(mid) < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == joined() || joined_key(lo) != key)
+			return false;
+		result.insert(result.end(), m_matches.begin() + m_offsets[lo], m_matches.begin() + m_offsets[lo + 1]);
+		return true;
+	}
+
+	/* the number of joined keys, and of their matches */
+	size_t joined() const {
+		return m_key_offsets.size() - 1;
+	}
+
+	size_t pairs() const {
+		return m_matches.size();
+	}
+};
+
+} /* namespace storage */
+
+#endif /* _SIMILARITY_JOIN_HPP_ */
@@ -0,0 +1,433 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "flat_bk_tree.hpp"
+
+// A versioned binary snapshot of the index over the medicines to which we translate:
+// the vocabulary (the keys of the BK-tree), the posting list of each word, the medicine names and the tree itself.
+// The snapshot is either built in memory or mapped from a file, and all lookups run directly on its bytes.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//   header | tree chars | tree nodes | tree edges | posting offsets | postings | hash slots | name offsets | name chars
+// Word ids are the node ids of the tree (the words erased from the tree keep their ids, with empty posting lists), so the posting list of word 'w' is postings[postingOffsets[w] .. postingOffsets[w + 1]).
+// The postings are either plain row ids (uint32) or, in the compressed format, delta+varint encoded lists at byte offsets:
+// the first row, then the gaps between consecutive rows, 7 bits per byte with the high bit marking a continuation.
+
+enum class postingFormat : uint32_t { plain = 0, varint = 1 };
+
+// The posting list of a word: the rows of the medicines containing it, in increasing order (decoded on the fly if compressed)
+class postingList {
+  const uint8_t* first = nullptr;
+  const uint8_t* last = nullptr;
+  bool compressed = false;
+
+  public:
+  class iterator {
+    const uint8_t* pos;
+    const uint8_t* next;
+    const uint8_t* last;
+    uint32_t value;
+    bool compressed;
+
+    void decode() {
+      if (pos == last)
+        return;
+      if (!compressed) {
+        memcpy(&value, pos, sizeof(value));
+        next = pos + sizeof(value);
+        return;
+      }
+      uint32_t gap = 0;
+      next = pos;
+      for (unsigned shift = 0; ; shift += 7) {
+        uint8_t byte = *next++;
+        gap |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+          break;
+      }
+      value += gap;
+    }
+
+    public:
+    iterator(const uint8_t* pos, const uint8_t* last, bool compressed) : pos(pos), next(pos), last(last), value(0), compressed(compressed) {
+      decode();
+    }
+
+    uint32_t operator*() const { return value; }
+    iterator& operator++() {
+      pos = next;
+      decode();
+      return *this;
+    }
+    bool operator!=(const iterator& other) const { return pos != other.pos; }
+    bool operator==(const iterator& other) const { return pos == other.pos; }
+  };
+
+  postingList() = default;
+  postingList(const uint8_t* first, const uint8_t* last, bool compressed) : first(first), last(last), compressed(compressed) { }
+
+  iterator begin() const { return iterator(first, last, compressed); }
+  iterator end() const { return iterator(last, last, compressed); }
+  bool empty() const { return first == last; }
+
+  // Whether 'row' is in the list: a binary search over the plain rows, a scan up to 'row' when compressed
+  bool contains(uint32_t row) const {
+    if (compressed) {
+      for (auto value : *this)
+        if (value >= row)
+          return value == row;
+      return false;
+    }
+    size_t low = 0, high = (last - first) / sizeof(uint32_t);
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      uint32_t value;
+      memcpy(&value, first + mid * sizeof(uint32_t), sizeof(value));
+      if (value < row)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    if (low == (last - first) / sizeof(uint32_t))
+      return false;
+    uint32_t value;
+    memcpy(&value, first + low * sizeof(uint32_t), sizeof(value));
+    return value == row;
+  }
+};
+
+// Append the delta+varint encoding of the increasing 'rows' to 'out'
+template <typename Rows>
+void encodePostings(const Rows& rows, std::vector<uint8_t>& out) {
+  uint32_t previous = 0;
+  for (uint32_t row : rows) {
+    uint32_t gap = row - previous;
+    previous = row;
+    for (; gap >= 0x80; gap >>= 7)
+      out.push_back(uint8_t(gap) | 0x80);
+    out.push_back(uint8_t(gap));
+  }
+}
+
+// FNV-1a, used both for the hash slots of the vocabulary and to fingerprint the source file
+inline uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+  for (size_t index = 0; index != size; ++index) {
+    hash ^= static_cast<uint8_t>(data[index]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Fingerprint of a file's content (0 if it could not be read)
+inline uint64_t hashFile(const std::string& fileName) {
+  std::ifstream input(fileName, std::ios::binary);
+  if (!input.is_open())
+    return 0;
+  std::vector<char> buffer(1 << 16);
+  uint64_t hash = fnv1a(nullptr, 0);
+  while (input.read(buffer.data(), buffer.size()) || input.gcount())
+    hash = fnv1a(buffer.data(), input.gcount(), hash);
+  return hash;
+}
+
+template <typename Distance>
+class indexSnapshot {
+  public:
+  typedef storage::flat_bktree_view<uint32_t, Distance> treeView;
+  static constexpr uint32_t npos = UINT32_MAX;
+  static constexpr uint32_t version = 3;
+
+  private:
+  static constexpr char magic[8] = {'L', 'A', 'N', 'G', 'S', 'O', 'M', 'E'};
+
+  struct section {
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  struct header {
+    char magic[8];
+    uint32_t version;
+    // The minimal length of the words, with which the vocabulary has been filtered
+    uint32_t minLen;
+    // Fingerprint of the list of medicines the snapshot has been built from
+    uint64_t sourceHash;
+    postingFormat format;
+    uint32_t padding;
+    section treeChars, treeNodes, treeEdges, postingOffsets, postings, slots, nameOffsets, nameChars;
+  };
+
+  // Either the mapped file or the buffer built in memory
+  std::vector<char> buffer;
+  const char* base = nullptr;
+  size_t mappedSize = 0;
+
+  const header* head = nullptr;
+  treeView tree_;
+  const uint32_t* postingOffsets = nullptr;
+  const uint8_t* postings_ = nullptr;
+  // The size of a unit of 'postings_': 4 bytes for the plain rows, a byte when compressed
+  uint32_t postingUnit = 4;
+  const uint32_t* slots = nullptr;
+  uint64_t slotMask = 0;
+  const uint32_t* nameOffsets = nullptr;
+  const char* nameChars = nullptr;
+
+  template <typename T>
+  const T* at(const section& s) const {
+    return reinterpret_cast<const T*>(base + s.offset);
+  }
+
+  // Check that the sections lie within the bytes and set up the pointers
+  bool attach(const char* bytes, size_t size) {
+    if (size < sizeof(header))
+      return false;
+    auto h = reinterpret_cast<const header*>(bytes);
+    if (memcmp(h->magic, magic, sizeof(magic)) || (h->version != version))
+      return false;
+    auto fits = [size](const section& s, size_t elemSize) -> bool {
+      return (s.offset % 8 == 0) && (s.offset <= size) && (s.count <= (size - s.offset) / elemSize);
+    };
+    if (!fits(h->treeChars, 1) || !fits(h->treeNodes, sizeof(typename treeView::node)) || !fits(h->treeEdges, sizeof(typename treeView::edge))
+        || !fits(h->postingOffsets, 4) || !fits(h->postings, (h->format == postingFormat::plain) ? 4 : 1) || !fits(h->slots, 4) || !fits(h->nameOffsets, 4) || !fits(h->nameChars, 1))
+      return false;
+    if ((h->format != postingFormat::plain) && (h->format != postingFormat::varint))
+      return false;
+    if ((h->postingOffsets.count != h->treeNodes.count + 1) || (h->nameOffsets.count == 0) || (h->slots.count & (h->slots.count - 1)))
+      return false;
+
+    base = bytes;
+    head = h;
+    tree_ = treeView(at<char>(h->treeChars), h->treeChars.count, at<typename treeView::node>(h->treeNodes), h->treeNodes.count,
+                     at<typename treeView::edge>(h->treeEdges), h->treeEdges.count);
+    postingOffsets = at<uint32_t>(h->postingOffsets);
+    postings_ = at<uint8_t>(h->postings);
+    postingUnit = (h->format == postingFormat::plain) ? 4 : 1;
+    slots = at<uint32_t>(h->slots);
+    slotMask = h->slots.count - 1;
+    nameOffsets = at<uint32_t>(h->nameOffsets);
+    nameChars = at<char>(h->nameChars);
+    return true;
+  }
+
+  void release() {
+    if (mappedSize)
+      munmap(const_cast<char*>(base), mappedSize);
+    mappedSize = 0;
+    base = nullptr;
+    head = nullptr;
+    buffer.clear();
+  }
+
+  public:
+  indexSnapshot() = default;
+  indexSnapshot(const indexSnapshot&) = delete;
+  indexSnapshot& operator=(const indexSnapshot&) = delete;
+  ~indexSnapshot() { release(); }
+
+  // Map the snapshot in 'fileName', whichever list it has been built from. Fails if the file is missing, corrupt or of another version
+  bool open(const std::string& fileName) {
+    release();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size < static_cast<off_t>(sizeof(header)))) {
+      close(fd);
+      return false;
+    }
+    void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+      return false;
+    mappedSize = info.st_size;
+    base = static_cast<const char*>(addr);
+    if (!attach(base, mappedSize)) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  // Map the snapshot in 'fileName'. Fails as well if it is of another posting format, or stale
+  bool open(const std::string& fileName, uint64_t sourceHash, uint32_t minLen, postingFormat format = postingFormat::plain) {
+    if (!open(fileName))
+      return false;
+    if ((head->sourceHash != sourceHash) || (head->minLen != minLen) || (head->format != format)) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  // Serialize the index: 'postings[w]' is the list of rows of word (node) 'w', 'names.at(row)' the medicine at 'row'
+  template <typename Postings, typename Names>
+  void build(const treeView& tree, const Postings& postings, const Names& names, uint32_t nameCount, uint64_t sourceHash, uint32_t minLen,
+             postingFormat format = postingFormat::plain) {
+    release();
+    const uint32_t wordCount = tree.size();
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.minLen = minLen;
+    h.sourceHash = sourceHash;
+    h.format = format;
+
+    // Reserve the sections
+    uint64_t size = sizeof(header);
+    auto reserve = [&size](section& s, uint64_t count, size_t elemSize) -> void {
+      size = (size + 7) & ~uint64_t(7);
+      s.offset = size;
+      s.count = count;
+      size += count * elemSize;
+    };
+    // The postings are counted in units: rows when plain, bytes when compressed
+    uint64_t postingCount = 0, nameCharCount = 0;
+    std::vector<uint8_t> encoded;
+    std::vector<uint32_t> encodedOffsets;
+    if (format == postingFormat::varint) {
+      for (uint32_t word = 0; word != wordCount; ++word) {
+        encodedOffsets.push_back(encoded.size());
+        encodePostings(postings[word], encoded);
+      }
+      encodedOffsets.push_back(encoded.size());
+      postingCount = encoded.size();
+    } else {
+      for (uint32_t word = 0; word != wordCount; ++word)
+        postingCount += postings[word].size();
+    }
+    for (uint32_t row = 0; row != nameCount; ++row)
+      nameCharCount += names.at(row).size();
+    uint64_t slotCount = 1;
+    while (slotCount < 2 * uint64_t(wordCount))
+      slotCount <<= 1;
+    reserve(h.treeChars, tree.n_chars(), 1);
+    reserve(h.treeNodes, wordCount, sizeof(typename treeView::node));
+    reserve(h.treeEdges, tree.n_edges(), sizeof(typename treeView::edge));
+    reserve(h.postingOffsets, wordCount + 1, 4);
+    reserve(h.postings, postingCount, (format == postingFormat::plain) ? 4 : 1);
+    reserve(h.slots, slotCount, 4);
+    reserve(h.nameOffsets, nameCount + 1, 4);
+    reserve(h.nameChars, nameCharCount, 1);
+    buffer.assign((size + 7) & ~uint64_t(7), 0);
+
+    // And fill them in
+    char* bytes = buffer.data();
+    auto sectionAt = [bytes](const section& s) -> char* { return bytes + s.offset; };
+    memcpy(bytes, &h, sizeof(h));
+    memcpy(sectionAt(h.treeChars), tree.chars(), tree.n_chars());
+    memcpy(sectionAt(h.treeNodes), tree.nodes(), wordCount * sizeof(typename treeView::node));
+    memcpy(sectionAt(h.treeEdges), tree.edges(), tree.n_edges() * sizeof(typename treeView::edge));
+
+    auto offsets = reinterpret_cast<uint32_t*>(sectionAt(h.postingOffsets));
+    if (format == postingFormat::varint) {
+      memcpy(offsets, encodedOffsets.data(), encodedOffsets.size() * sizeof(uint32_t));
+      memcpy(sectionAt(h.postings), encoded.data(), encoded.size());
+    } else {
+      auto rows = reinterpret_cast<uint32_t*>(sectionAt(h.postings));
+      uint32_t filled = 0;
+      for (uint32_t word = 0; word != wordCount; ++word) {
+        offsets[word] = filled;
+        for (auto row : postings[word])
+          rows[filled++] = row;
+      }
+      offsets[wordCount] = filled;
+    }
+
+    auto table = reinterpret_cast<uint32_t*>(sectionAt(h.slots));
+    std::fill(table, table + slotCount, npos);
+    for (uint32_t word = 0; word != wordCount; ++word) {
+      auto key = tree.key(word);
+      uint64_t slot = fnv1a(key.data(), key.size()) & (slotCount - 1);
+      while (table[slot] != npos)
+        slot = (slot + 1) & (slotCount - 1);
+      table[slot] = word;
+    }
+
+    auto nameOffs = reinterpret_cast<uint32_t*>(sectionAt(h.nameOffsets));
+    char* chars = sectionAt(h.nameChars);
+    nameOffs[0] = 0;
+    for (uint32_t row = 0; row != nameCount; ++row) {
+      const auto& name = names.at(row);
+      memcpy(chars + nameOffs[row], name.data(), name.size());
+      nameOffs[row + 1] = nameOffs[row] + name.size();
+    }
+
+    attach(buffer.data(), buffer.size());
+  }
+
+  // Write the snapshot into 'fileName'. The file is replaced at once, so that a mapping of the previous snapshot stays valid
+  bool save(const std::string& fileName) const {
+    if (!head)
+      return false;
+    // Unique to the process: the processes matching the shards of a database file may all rewrite a stale snapshot at once
+    std::string tempFileName = fileName + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream output(tempFileName, std::ios::binary | std::ios::trunc);
+      size_t size = mappedSize ? mappedSize : buffer.size();
+      output.write(base, size);
+      if (!output)
+        return false;
+    }
+    return rename(tempFileName.c_str(), fileName.c_str()) == 0;
+  }
+
+  // The id of 'word' in the vocabulary, 'npos' if not present (or erased)
+  uint32_t find(std::string_view word) const {
+    for (uint64_t slot = fnv1a(word.data(), word.size()) & slotMask; slots[slot] != npos; slot = (slot + 1) & slotMask)
+      if (tree_.key(slots[slot]) == word)
+        return tree_.erased(slots[slot]) ? npos : slots[slot];
+    return npos;
+  }
+
+  postingList postings(uint32_t word) const {
+    return postingList(postings_ + postingOffsets[word] * postingUnit, postings_ + postingOffsets[word + 1] * postingUnit, postingUnit == 1);
+  }
+
+  postingFormat format() const {
+    return head->format;
+  }
+
+  // The fingerprint of the list of medicines the snapshot has been built from
+  uint64_t sourceHash() const {
+    return head->sourceHash;
+  }
+
+  uint32_t minLen() const {
+    return head->minLen;
+  }
+
+  // The size of all posting lists, in bytes
+  uint64_t postingBytes() const {
+    return head->postings.count * postingUnit;
+  }
+
+  const treeView& tree() const {
+    return tree_;
+  }
+
+  std::string_view medicine(uint32_t row) const {
+    if (row + 1 >= head->nameOffsets.count)
+      return std::string_view();
+    return std::string_view(nameChars + nameOffsets[row], nameOffsets[row + 1] - nameOffsets[row]);
+  }
+
+  uint32_t medicineCount() const {
+    return head->nameOffsets.count - 1;
+  }
+};
+
+#endif /* _SNAPSHOT_HPP_ */
@@ -0,0 +1,265 @@
+#ifndef _STATS_HPP_
+#define _STATS_HPP_
+
+// Opt-in instrumentation of the hot paths, compiled in with -DSTATS (make STATS=1) and compiled out otherwise:
+// - per-query counters of the fuzzy searches (nodes visited, distances computed, children pruned, hash probes),
+// - wall and CPU times of the phases (building the index, matching, ..),
+// - latency histograms of the common name, synonym and price paths, along with the slowest rows.
+// Everything is dumped as JSON into STATS_FILE at exit.
+//
+// The hooks are macros, so that the instrumented code does not change when the stats are compiled out:
+//   STATS_COUNT(counter)     count an event of the current query, e.g. STATS_COUNT(nodesVisited)
+//   STATS_QUERY_BEGIN/END()  delimit a query of a fuzzy index
+//   STATS_PHASE(phase)       time the rest of the enclosing scope as 'phase'
+//   STATS_PATH(path)         time the rest of the enclosing scope as one run of 'path'
+//   STATS_ROW(row)           time the rest of the enclosing scope as the matching of 'row'
+
+#ifdef STATS
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <algorithm>
+#include <time.h>
+
+#define STATS_FILE "stats.json"
+
+namespace stats {
+
+enum counter { nodesVisited, distancesComputed, signaturesPruned, childrenPruned, deletionProbes, candidates, counterCount };
+enum phase { dissolveMeds, buildStorage, buildSnapshot, openSnapshot, buildDeletions, readRows, joinParts, matching, phaseCount };
+enum path { commonName, synonyms, prices, pathCount };
+
+static constexpr const char* counterNames[counterCount] = {"nodes_visited", "distances_computed", "signatures_pruned", "children_pruned", "deletion_probes", "candidates"};
+static constexpr const char* phaseNames[phaseCount] = {"dissolveMeds", "buildStorage", "buildSnapshot", "openSnapshot", "buildDeletions", "readRows", "joinParts", "matching"};
+static constexpr const char* pathNames[pathCount] = {"common_name", "synonyms", "prices"};
+
+// How many of the slowest rows are kept
+static constexpr size_t slowestCount = 16;
+
+// Values in power-of-two buckets: bucket 'b' holds the values in [2^(b-1), 2^b), bucket 0 the zeros
+struct histogram {
+  uint64_t buckets[65] = {};
+  uint64_t count = 0, sum = 0, max = 0;
+
+  void add(uint64_t value) {
+    buckets[value ? 64 - __builtin_clzll(value) : 0]++;
+    count++;
+    sum += value;
+    max = std::max(max, value);
+  }
+
+  void merge(const histogram& other) {
+    for (unsigned b = 0; b != 65; ++b)
+      buckets[b] += other.buckets[b];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+  }
+};
+
+// The stats of a thread, merged at exit
+struct threadStats {
+  uint64_t current[counterCount] = {};
+  uint64_t totals[counterCount] = {};
+  histogram perQuery[counterCount];
+  uint64_t queries = 0;
+  histogram latency[pathCount];
+  std::vector<std::pair<uint64_t, std::string>> slowestRows;
+};
+
+struct phaseTime {
+  uint64_t calls = 0;
+  double wall = 0, cpu = 0;
+};
+
+class registry {
+  std::mutex lock;
+  std::vector<std::unique_ptr<threadStats>> threads;
+  phaseTime phases[phaseCount];
+
+  static void writeHistogram(std::ofstream& out, const histogram& h) {
+    out << "{\"count\": " << h.count << ", \"mean\": " << (h.count ? double(h.sum) / h.count : 0.0) << ", \"max\": " << h.max << ", \"buckets\": [";
+    bool first = true;
+    for (unsigned b = 0; b != 65; ++b) {
+      if (!h.buckets[b])
+        continue;
+      uint64_t low = b ? (uint64_t(1) << (b - 1)) : 0;
+      out << (first ? "" : ", ") << "{\"from\": " << low << ", \"count\": " << h.buckets[b] << "}";
+      first = false;
+    }
+    out << "]}";
+  }
+
+  static std::string escape(std::string_view str) {
+    std::string ret;
+    for (char c : str) {
+      if ((c == '"') || (c == '\\'))
+        ret += '\\';
+      if (static_cast<unsigned char>(c) < 0x20)
+        continue;
+      ret += c;
+    }
+    return ret;
+  }
+
+  public:
+  ~registry() {
+    dump(STATS_FILE);
+  }
+
+  threadStats& local() {
+    thread_local threadStats* mine = nullptr;
+    if (!mine) {
+      std::lock_guard<std::mutex> guard(lock);
+      threads.emplace_back(new threadStats());
+      mine = threads.back().get();
+    }
+    return *mine;
+  }
+
+  void addPhase(phase p, double wall, double cpu) {
+    std::lock_guard<std::mutex> guard(lock);
+    phases[p].calls++;
+    phases[p].wall += wall;
+    phases[p].cpu += cpu;
+  }
+
+  void dump(const std::string& fileName) {
+    std::lock_guard<std::mutex> guard(lock);
+    threadStats all;
+    for (auto& t : threads) {
+      for (unsigned c = 0; c != counterCount; ++c) {
+        all.totals[c] += t->totals[c];
+        all.perQuery[c].merge(t->perQuery[c]);
+      }
+      all.queries += t->queries;
+      for (unsigned p = 0; p != pathCount; ++p)
+        all.latency[p].merge(t->latency[p]);
+      all.slowestRows.insert(all.slowestRows.end(), t->slowestRows.begin(), t->slowestRows.end());
+    }
+    std::sort(all.slowestRows.begin(), all.slowestRows.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    all.slowestRows.resize(std::min(all.slowestRows.size(), slowestCount));
+
+    std::ofstream out(fileName);
+    out << "{\n  \"phases\": {";
+    for (unsigned p = 0; p != phaseCount; ++p)
+      out << (p ? "," : "") << "\n    \"" << phaseNames[p] << "\": {\"calls\": " << phases[p].calls
+          << ", \"wall_ms\": " << phases[p].wall * 1e3 << ", \"cpu_ms\": " << phases[p].cpu * 1e3 << "}";
+    out << "\n  },\n  \"queries\": " << all.queries << ",\n  \"counters\": {";
+    for (unsigned c = 0; c != counterCount; ++c)
+      out << (c ? "," : "") << "\n    \"" << counterNames[c] << "\": " << all.totals[c];
+    out << "\n  },\n  \"per_query\": {";
+    for (unsigned c = 0; c != counterCount; ++c) {
+      out << (c ? "," : "") << "\n    \"" << counterNames[c] << "\": ";
+      writeHistogram(out, all.perQuery[c]);
+    }
+    out << "\n  },\n  \"latency_ns\": {";
+    for (unsigned p = 0; p != pathCount; ++p) {
+      out << (p ? "," : "") << "\n    \"" << pathNames[p] << "\": ";
+      writeHistogram(out, all.latency[p]);
+    }
+    out << "\n  },\n  \"slowest_rows\": [";
+    for (size_t index = 0; index != all.slowestRows.size(); ++index)
+      out << (index ? "," : "") << "\n    {\"ns\": " << all.slowestRows[index].first << ", \"row\": \"" << escape(all.slowestRows[index].second) << "\"}";
+    out << "\n  ]\n}\n";
+  }
+};
+
+inline registry& global() {
+  static registry instance;
+  return instance;
+}
+
+inline void count(counter c) {
+  global().local().current[c]++;
+}
+
+inline void beginQuery() {
+  auto& t = global().local();
+  std::fill(t.current, t.current + counterCount, 0);
+}
+
+inline void endQuery() {
+  auto& t = global().local();
+  for (unsigned c = 0; c != counterCount; ++c) {
+    t.totals[c] += t.current[c];
+    t.perQuery[c].add(t.current[c]);
+  }
+  t.queries++;
+}
+
+inline double cpuSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Times the scope as a phase
+class scopedPhase {
+  phase p;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  double cpuStart = cpuSeconds();
+
+  public:
+  explicit scopedPhase(phase p) : p(p) { }
+  ~scopedPhase() {
+    global().addPhase(p, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), cpuSeconds() - cpuStart);
+  }
+};
+
+// Times the scope as one run of a path, or as the matching of a row
+class scopedLatency {
+  int p;
+  std::string_view row;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  public:
+  scopedLatency(path p) : p(p) { }
+  scopedLatency(std::string_view row) : p(-1), row(row) { }
+  ~scopedLatency() {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    auto& t = global().local();
+    if (p >= 0) {
+      t.latency[p].add(ns);
+      return;
+    }
+    // Keep the slowest rows (the row is cut, since only its beginning is needed to find it)
+    auto& rows = t.slowestRows;
+    if ((rows.size() == slowestCount) && (rows.back().first >= ns))
+      return;
+    if (rows.size() == slowestCount)
+      rows.pop_back();
+    auto pos = std::find_if(rows.begin(), rows.end(), [ns](auto& elem) { return elem.first < ns; });
+    rows.emplace(pos, ns, std::string(row.substr(0, 120)));
+  }
+};
+
+} /* namespace stats */
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_COUNT(counter) stats::count(stats::counter)
+#define STATS_QUERY_BEGIN() stats::beginQuery()
+#define STATS_QUERY_END() stats::endQuery()
+#define STATS_PHASE(phase) stats::scopedPhase STATS_CONCAT(statsPhase, __LINE__){stats::phase}
+#define STATS_PATH(path) stats::scopedLatency STATS_CONCAT(statsPath, __LINE__){stats::path}
+#define STATS_ROW(row) stats::scopedLatency STATS_CONCAT(statsRow, __LINE__){std::string_view(row)}
+
+#else
+
+#define STATS_COUNT(counter) ((void)0)
+#define STATS_QUERY_BEGIN() ((void)0)
+#define STATS_QUERY_END() ((void)0)
+#define STATS_PHASE(phase) ((void)0)
+#define STATS_PATH(path) ((void)0)
+#define STATS_ROW(row) ((void)0)
+
+#endif /* STATS */
+
+#endif /* _STATS_HPP_ */
@@ -0,0 +1,75 @@
+#ifndef _STRING_POOL_HPP_
+#define _STRING_POOL_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// Interned strings: each distinct string is stored once, in one character buffer, and gets a dense id
+// (the order in which it was first interned). Ids can thus index plain vectors, e.g. the posting lists of the words.
+class stringPool {
+  public:
+  static constexpr uint32_t npos = UINT32_MAX;
+
+  private:
+  std::vector<char> chars;
+  // The string with id 'i' is chars[offsets[i] .. offsets[i + 1])
+  std::vector<uint32_t> offsets = {0};
+  // Open addressing over the ids, at most half full
+  std::vector<uint32_t> slots = std::vector<uint32_t>(16, npos);
+
+  static size_t hashOf(std::string_view str) {
+    return std::hash<std::string_view>()(str);
+  }
+
+  size_t slotOf(std::string_view str) const {
+    size_t mask = slots.size() - 1, slot = hashOf(str) & mask;
+    while ((slots[slot] != npos) && (at(slots[slot]) != str))
+      slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  void grow() {
+    std::vector<uint32_t> old(2 * slots.size(), npos);
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (uint32_t id = 0; id != size(); ++id) {
+      size_t slot = hashOf(at(id)) & mask;
+      while (slots[slot] != npos)
+        slot = (slot + 1) & mask;
+      slots[slot] = id;
+    }
+  }
+
+  public:
+  // The id of 'str', which is added if not yet present
+  uint32_t intern(std::string_view str) {
+    size_t slot = slotOf(str);
+    if (slots[slot] != npos)
+      return slots[slot];
+    uint32_t id = size();
+    chars.insert(chars.end(), str.begin(), str.end());
+    offsets.push_back(chars.size());
+    slots[slot] = id;
+    if (2 * size() > slots.size())
+      grow();
+    return id;
+  }
+
+  // The id of 'str', 'npos' if not present
+  uint32_t find(std::string_view str) const {
+    return slots[slotOf(str)];
+  }
+
+  std::string_view at(uint32_t id) const {
+    return std::string_view(chars.data() + offsets[id], offsets[id + 1] - offsets[id]);
+  }
+
+  uint32_t size() const {
+    return offsets.size() - 1;
+  }
+};
+
+#endif /* _STRING_POOL_HPP_ */
@@ -0,0 +1,211 @@
+#ifndef _TOKENIZER_HPP_
+#define _TOKENIZER_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+// Splitting and trimming of medicine names, without regular expressions:
+// each mode is a table of separator characters, built at compile-time, and the parts are the maximal runs of non-separators.
+
+// A set of characters, as a lookup table
+struct charClass {
+  bool table[256] = {};
+
+  constexpr bool operator()(char c) const {
+    return table[static_cast<uint8_t>(c)];
+  }
+};
+
+// The whitespaces of the "C" locale (what '\s' matches), along with 'chars'
+constexpr charClass makeClass(std::string_view chars) {
+  charClass ret;
+  for (char c : std::string_view(" \t\n\v\f\r"))
+    ret.table[static_cast<uint8_t>(c)] = true;
+  for (char c : chars)
+    ret.table[static_cast<uint8_t>(c)] = true;
+  return ret;
+}
+
+// Split 'str' into parts
+enum class SplitMode {DE, EN, EN_PRICE};
+
+// The separators of each mode. Do not change these options! (unless you are sure about that)
+constexpr charClass deSeparators = [] {
+  // supporting german references (no whitespaces)
+  charClass ret;
+  ret.table[static_cast<uint8_t>('-')] = ret.table[static_cast<uint8_t>(',')] = true;
+  return ret;
+}();
+constexpr charClass enSeparators = makeClass("-,/'`"); // supporting drugbank synonyms
+constexpr charClass enPriceSeparators = makeClass("-,/'`=.%"); // supporting drugbank prices
+
+// What 'trim' removes from both ends
+constexpr charClass trimmed = makeClass("-,'");
+
+constexpr const charClass& separatorsOf(SplitMode mode) {
+  return (mode == SplitMode::DE) ? deSeparators : ((mode == SplitMode::EN) ? enSeparators : enPriceSeparators);
+}
+
+// Left trim
+inline std::string_view ltrim(std::string_view s) {
+  size_t index = 0;
+  while ((index != s.size()) && trimmed(s[index]))
+    ++index;
+  return s.substr(index);
+}
+
+// Right trim
+inline std::string_view rtrim(std::string_view s) {
+  size_t size = s.size();
+  while (size && trimmed(s[size - 1]))
+    --size;
+  return s.substr(0, size);
+}
+
+// Both trim
+inline std::string trim(std::string_view s) {
+  return std::string(ltrim(rtrim(s)));
+}
+
+// Cast the string to lowercase
+inline std::string strToLower(std::string_view str) {
+  std::string ret;
+  ret.reserve(str.size());
+  for (unsigned index = 0, limit = str.size(); index != limit; ++index)
+    ret.push_back(tolower(str[index]));
+  return ret;
+}
+
+// The ASCII transliteration, lowercased, of the non-ASCII code point 'cp' (as 'unidecode' of the Python parser gives it for
+// the characters of the Drugbank vocabulary: Latin-1 and Greek letters, dashes, quotes, spaces, super- and subscript digits), empty if unknown
+inline std::string_view asciiOf(uint32_t cp) {
+  // U+00C0 .. U+00FF
+  static constexpr std::string_view latin1[64] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", "x", "o", "u", "u", "u", "u", "y", "th", "ss",
+    "a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+    "d", "n", "o", "o", "o", "o", "o", "/", "o", "u", "u", "u", "u", "y", "th", "y"};
+  // U+0391 .. U+03A9 and U+03B1 .. U+03C9, the same letters but for the final sigma (U+03C2, unassigned in uppercase)
+  static constexpr std::string_view greek[25] = {
+    "a", "b", "g", "d", "e", "z", "e", "th", "i", "k", "l", "m", "n", "x", "o", "p", "r", "s", "s", "t", "u", "ph", "kh", "ps", "o"};
+  if ((cp >= 0xc0) && (cp <= 0xff))
+    return latin1[cp - 0xc0];
+  if ((cp >= 0x391) && (cp <= 0x3a9))
+    return greek[cp - 0x391];
+  if ((cp >= 0x3b1) && (cp <= 0x3c9))
+    return greek[cp - 0x3b1];
+  if ((cp >= 0x2080) && (cp <= 0x2089))
+    return std::string_view("0123456789").substr(cp - 0x2080, 1);
+  if ((cp == 0x2070) || ((cp >= 0x2074) && (cp <= 0x2079)))
+    return std::string_view("0123456789").substr(cp - 0x2070, 1);
+  if ((cp == 0xa0) || ((cp >= 0x2002) && (cp <= 0x200a)))
+    return " ";
+  switch (cp) {
+    case 0xb1: return "+-";
+    case 0xb2: return "2";
+    case 0xb3: return "3";
+    case 0xb5: return "u";
+    case 0xb9: return "1";
+    case 0x2010: case 0x2011: case 0x2012: case 0x2013: case 0x2212: return "-";
+    case 0x2014: case 0x2015: return "--";
+    case 0x2018: case 0x2019: case 0x2032: return "'";
+    case 0x201c: case 0x201d: case 0x2033: return "\"";
+    case 0x2192: return "->";
+    default: return "";
+  }
+}
+
+// Cast the string to lowercase, transliterating its UTF-8 encoded non-ASCII characters (thus the same as 'strToLower' for ASCII)
+inline std::string foldToLower(std::string_view str) {
+  std::string ret;
+  ret.reserve(str.size());
+  for (size_t index = 0, size = str.size(); index != size; ) {
+    uint8_t c = str[index];
+    if (c < 0x80) {
+      ret.push_back(tolower(c));
+      ++index;
+      continue;
+    }
+    // Decode the code point (an invalid byte is dropped)
+    unsigned length = (c >= 0xf0) ? 4 : ((c >= 0xe0) ? 3 : ((c >= 0xc0) ? 2 : 1));
+    uint32_t cp = (length == 1) ? 0 : (c & (0x7f >> length));
+    if (index + length > size)
+      length = size - index;
+    for (unsigned pos = 1; pos < length; ++pos)
+      cp = (cp << 6) | (static_cast<uint8_t>(str[index + pos]) & 0x3f);
+    ret += asciiOf(cp);
+    index += length;
+  }
+  return ret;
+}
+
+inline const std::vector<std::string> invalid = {
+  // Empty word
+  "",
+  // Related to medicins
+  "g", "mg", "mcg", "ml", "mikrogramm", "unit"
+  // Related to grammar
+  "zur", "zum", "in", "eine", "einer", "ohne"
+};
+
+// Check if 'str' appears in 'invalid'
+inline bool isInvalid(std::string_view str) {
+  if (str.size() == 1)
+    return true;
+  // All invalid words are short, so the check can be done without allocating
+  char casted[16];
+  if (str.size() > sizeof(casted))
+    return false;
+  for (unsigned index = 0; index != str.size(); ++index)
+    casted[index] = tolower(str[index]);
+  std::string_view view(casted, str.size());
+  return std::any_of(invalid.begin(), invalid.end(), [view](const std::string& elem){ return view == elem; });
+}
+
+inline bool hasOnlyDigits(std::string_view str) {
+  return std::all_of(str.begin(), str.end(), ::isdigit);
+}
+
+// Call 'callback' with each part of 'str'. The parts are views into 'str',
+// except when digits had to be stripped out of them (modes DE and EN_PRICE), in which case they point into a scratch buffer
+template <typename Callback>
+void forEachPart(std::string_view str, SplitMode mode, Callback&& callback) {
+  const charClass& separators = separatorsOf(mode);
+  const bool stripDigits = (mode == SplitMode::DE) || (mode == SplitMode::EN_PRICE);
+  std::string stripped;
+  for (size_t index = 0, size = str.size(); index != size; ) {
+    while ((index != size) && separators(str[index]))
+      ++index;
+    size_t begin = index;
+    while ((index != size) && (!separators(str[index])))
+      ++index;
+    if (begin == index)
+      continue;
+
+    std::string_view curr = str.substr(begin, index - begin);
+    if (stripDigits) {
+      if (std::any_of(curr.begin(), curr.end(), ::isdigit)) {
+        if (hasOnlyDigits(curr))
+          continue;
+        stripped.assign(curr.begin(), curr.end());
+        stripped.erase(std::remove_if(stripped.begin(), stripped.end(), ::isdigit), stripped.end());
+        curr = stripped;
+      }
+      if (isInvalid(curr))
+        continue;
+    }
+    callback(curr);
+  }
+}
+
+inline std::vector<std::string> splitUp(std::string_view str, SplitMode mode) {
+  std::vector<std::string> result;
+  forEachPart(str, mode, [&result](std::string_view part) { result.emplace_back(part); });
+  return result;
+}
+
+#endif /* _TOKENIZER_HPP_ */
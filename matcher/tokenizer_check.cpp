@@ -0,0 +1,139 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <algorithm>
+#include "tokenizer.hpp"
+
+using namespace std;
+
+// The differential check of tokenizer.hpp: the regex-based splitting and trimming it replaced are kept here,
+// and both run over every line of the lists, every '|'-separated piece and every ',' field of them, raw and lowercased,
+// in all the modes. Any difference is printed, and the exit status is non-zero.
+// Example: ./tokenizer_check ../meds/en_meds.csv ../meds/de_meds.csv
+
+namespace reference {
+
+string ltrim(const string& s) {
+  static const regex leading("^[\\s\\-,']+");
+  return regex_replace(s, leading, string(""));
+}
+
+string rtrim(const string& s) {
+  static const regex trailing("[\\s\\-,']+$");
+  return regex_replace(s, trailing, string(""));
+}
+
+string trim(const string& s) {
+  return ltrim(rtrim(s));
+}
+
+string strToLower(string str) {
+  for (auto& c : str)
+    c = tolower(c);
+  return str;
+}
+
+const vector<string> invalid = {
+  "",
+  "g", "mg", "mcg", "ml", "mikrogramm", "unit"
+  "zur", "zum", "in", "eine", "einer", "ohne"
+};
+
+bool isInvalid(const string& str) {
+  if (str.size() == 1)
+    return true;
+  string casted = strToLower(str);
+  return find(invalid.begin(), invalid.end(), casted) != invalid.end();
+}
+
+bool hasOnlyDigits(const string& str) {
+  return all_of(str.begin(), str.end(), ::isdigit);
+}
+
+vector<string> splitUp(const string& str, SplitMode mode) {
+  static const regex de("[\\-,]+"), en("[\\s\\-,/'`]+"), enPrice("[\\s\\-,/'`=.%]+");
+  const regex& separators = (mode == SplitMode::DE) ? de : ((mode == SplitMode::EN) ? en : enPrice);
+  vector<string> result;
+  for (sregex_token_iterator it(str.begin(), str.end(), separators, -1), end; it != end; ++it) {
+    string curr = *it;
+    if (curr.empty())
+      continue;
+    if ((mode == SplitMode::DE) || (mode == SplitMode::EN_PRICE)) {
+      if (hasOnlyDigits(curr))
+        continue;
+      curr.erase(remove_if(curr.begin(), curr.end(), ::isdigit), curr.end());
+      if (isInvalid(curr))
+        continue;
+    }
+    result.push_back(curr);
+  }
+  return result;
+}
+
+} /* namespace reference */
+
+static const char* modeName(SplitMode mode) {
+  return (mode == SplitMode::DE) ? "DE" : ((mode == SplitMode::EN) ? "EN" : "EN_PRICE");
+}
+
+static uint64_t comparisons = 0, mismatches = 0;
+
+// Compare both implementations on 'str'
+static void check(const string& str) {
+  auto report = [&str](const string& what) {
+    if (++mismatches <= 20)
+      cerr << what << " differs on \"" << str << "\"" << endl;
+  };
+  ++comparisons;
+  if (trim(str) != reference::trim(str))
+    report("trim");
+  ++comparisons;
+  if (isInvalid(str) != reference::isInvalid(str))
+    report("isInvalid");
+  for (auto mode : {SplitMode::DE, SplitMode::EN, SplitMode::EN_PRICE}) {
+    ++comparisons;
+    if (splitUp(str, mode) != reference::splitUp(str, mode))
+      report(string("splitUp (") + modeName(mode) + ")");
+  }
+}
+
+// Split 'str' at each 'delimiter'
+static vector<string> pieces(const string& str, char delimiter) {
+  vector<string> result;
+  size_t begin = 0;
+  for (size_t end; (end = str.find(delimiter, begin)) != string::npos; begin = end + 1)
+    result.push_back(str.substr(begin, end - begin));
+  result.push_back(str.substr(begin));
+  return result;
+}
+
+int main(int argc, char** argv) {
+  vector<string> fileNames = {"../meds/en_meds.csv", "../meds/de_meds.csv"};
+  if (argc > 1)
+    fileNames.assign(argv + 1, argv + argc);
+
+  for (const auto& fileName : fileNames) {
+    ifstream input(fileName);
+    if (!input.is_open()) {
+      cerr << "file \"" << fileName << "\" could not open" << endl;
+      return 1;
+    }
+    for (string line; getline(input, line); ) {
+      vector<string> inputs = {line};
+      for (const auto& piece : pieces(line, '|')) {
+        inputs.push_back(piece);
+        for (const auto& field : pieces(piece, ','))
+          inputs.push_back(field);
+      }
+      for (const auto& str : inputs) {
+        check(str);
+        check(strToLower(str));
+      }
+    }
+  }
+
+  cout << comparisons << " comparisons, " << mismatches << " mismatches" << endl;
+  return mismatches ? 1 : 0;
+}
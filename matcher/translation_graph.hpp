@@ -0,0 +1,607 @@
+#ifndef _TRANSLATION_GRAPH_HPP_
+#define _TRANSLATION_GRAPH_HPP_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matcher.hpp"
+
+// The bipartite graph of the translator (translator.py), between the English medicines (side 0, the rows of the Drugbank vocabulary)
+// and the medicines of a target language (side 1, the rows of its list), written by 'match' along with the graph in text.
+// Each side holds its adjacency and the index of its tokens, in CSR form, along with a BK-Tree over its tokens for the parts
+// not found as such, and the names of its medicines, so that the translator maps the file and answers the queries right away,
+// instead of parsing both lists and the graph.
+//
+// Layout (native byte order, every section 8-byte aligned):
+//   header | for each side: neighbor offsets | neighbors | token offsets | token chars | posting offsets | postings | tree nodes | tree edges
+//            | name offsets | name chars | raw offsets | raw chars
+// The neighbors of row 'r' are neighbors[neighborOffsets[r] .. neighborOffsets[r + 1]), listed in the order in which the translator visits them.
+// The tokens are sorted, and the posting list of token 't' (the rows containing it, once per occurrence) is postings[postingOffsets[t] .. postingOffsets[t + 1]).
+// Node 't' of the tree is token 't', thus the keys of the tree are the token chars.
+// A name is what the translator shows for a row, a raw name what it identifies the row by (the Drugbank id, the line of the list).
+
+// Strip the whitespaces at both ends, as 'str.strip' of Python
+inline std::string_view trimSpaces(std::string_view str) {
+  constexpr charClass whitespaces = makeClass("");
+  while ((!str.empty()) && whitespaces(str.front()))
+    str.remove_prefix(1);
+  while ((!str.empty()) && whitespaces(str.back()))
+    str.remove_suffix(1);
+  return str;
+}
+
+// The medicines of a side, to build the graph from
+struct translationSide {
+  VS names, raws;
+  std::vector<VS> tokens;
+
+  void add(std::string name, std::string raw, VS rowTokens) {
+    names.push_back(std::move(name));
+    raws.push_back(std::move(raw));
+    tokens.push_back(std::move(rowTokens));
+  }
+
+  uint32_t size() const {
+    return names.size();
+  }
+};
+
+class translationGraph {
+  public:
+  static constexpr uint32_t version = 3;
+  enum side : uint32_t { english = 0, target = 1 };
+
+  private:
+  static constexpr char magic[8] = {'L', 'A', 'N', 'G', 'G', 'R', 'P', 'H'};
+
+  struct section {
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  struct sideSections {
+    section neighborOffsets, neighbors, tokenOffsets, tokenChars, postingOffsets, postings, treeNodes, treeEdges, nameOffsets, nameChars, rawOffsets, rawChars;
+  };
+
+  struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+    sideSections sides[2];
+  };
+
+  // The pointers into the sections of a side
+  struct sideView {
+    const uint32_t* neighborOffsets = nullptr;
+    const uint32_t* neighbors = nullptr;
+    const uint32_t* tokenOffsets = nullptr;
+    const char* tokenChars = nullptr;
+    const uint32_t* postingOffsets = nullptr;
+    const uint32_t* postings = nullptr;
+    medSnapshot::treeView tree;
+    const uint32_t* nameOffsets = nullptr;
+    const char* nameChars = nullptr;
+    const uint32_t* rawOffsets = nullptr;
+    const char* rawChars = nullptr;
+    uint32_t rowCount = 0, tokenCount = 0;
+  };
+
+  // Either the mapped file or the buffer built in memory
+  std::vector<char> buffer;
+  const char* base = nullptr;
+  size_t mappedSize = 0;
+  const header* head = nullptr;
+  sideView sides[2];
+
+  // The separators of the names and of the queries, as the translator splits them
+  static constexpr charClass englishSeparators = enSeparators;
+  static constexpr charClass querySeparators = makeClass(",/-");
+  static constexpr charClass targetSeparators = [] {
+    charClass ret;
+    ret.table[static_cast<uint8_t>('-')] = ret.table[static_cast<uint8_t>('_')] = true;
+    return ret;
+  }();
+
+  typedef medSnapshot::treeView::node treeNode;
+  typedef medSnapshot::treeView::edge treeEdge;
+
+  template <typename T>
+  const T* at(const section& s) const {
+    return reinterpret_cast<const T*>(base + s.offset);
+  }
+
+  static std::string_view stringAt(const uint32_t* offsets, const char* chars, uint32_t index) {
+    return std::string_view(chars + offsets[index], offsets[index + 1] - offsets[index]);
+  }
+
+  // Check that the sections lie within the bytes and set up the pointers
+  bool attach(const char* bytes, size_t size) {
+    if (size < sizeof(header))
+      return false;
+    auto h = reinterpret_cast<const header*>(bytes);
+    if (memcmp(h->magic, magic, sizeof(magic)) || (h->version != version))
+      return false;
+    auto fits = [size](const section& s, size_t elemSize) -> bool {
+      return (s.offset % 8 == 0) && (s.offset <= size) && (s.count <= (size - s.offset) / elemSize);
+    };
+    for (auto& s : h->sides) {
+      if (!fits(s.neighborOffsets, 4) || !fits(s.neighbors, 4) || !fits(s.tokenOffsets, 4) || !fits(s.tokenChars, 1) || !fits(s.postingOffsets, 4)
+          || !fits(s.postings, 4) || !fits(s.treeNodes, sizeof(treeNode)) || !fits(s.treeEdges, sizeof(treeEdge)) || !fits(s.nameOffsets, 4)
+          || !fits(s.nameChars, 1) || !fits(s.rawOffsets, 4) || !fits(s.rawChars, 1))
+        return false;
+      if ((s.neighborOffsets.count == 0) || (s.nameOffsets.count != s.neighborOffsets.count) || (s.rawOffsets.count != s.neighborOffsets.count)
+          || (s.tokenOffsets.count == 0) || (s.postingOffsets.count != s.tokenOffsets.count)
+          || (s.treeNodes.count != s.tokenOffsets.count - 1) || (s.treeEdges.count != std::max<uint64_t>(s.treeNodes.count, 1) - 1))
+        return false;
+    }
+
+    base = bytes;
+    head = h;
+    for (unsigned index = 0; index != 2; ++index) {
+      auto& s = h->sides[index];
+      auto& view = sides[index];
+      view.neighborOffsets = at<uint32_t>(s.neighborOffsets);
+      view.neighbors = at<uint32_t>(s.neighbors);
+      view.tokenOffsets = at<uint32_t>(s.tokenOffsets);
+      view.tokenChars = at<char>(s.tokenChars);
+      view.postingOffsets = at<uint32_t>(s.postingOffsets);
+      view.postings = at<uint32_t>(s.postings);
+      view.tree = medSnapshot::treeView(view.tokenChars, s.tokenChars.count, at<treeNode>(s.treeNodes), s.treeNodes.count,
+                                        at<treeEdge>(s.treeEdges), s.treeEdges.count);
+      view.nameOffsets = at<uint32_t>(s.nameOffsets);
+      view.nameChars = at<char>(s.nameChars);
+      view.rawOffsets = at<uint32_t>(s.rawOffsets);
+      view.rawChars = at<char>(s.rawChars);
+      view.rowCount = s.neighborOffsets.count - 1;
+      view.tokenCount = s.tokenOffsets.count - 1;
+    }
+    return true;
+  }
+
+  void release() {
+    if (mappedSize)
+      munmap(const_cast<char*>(base), mappedSize);
+    mappedSize = 0;
+    base = nullptr;
+    head = nullptr;
+    buffer.clear();
+  }
+
+  public:
+  translationGraph() = default;
+  translationGraph(const translationGraph&) = delete;
+  translationGraph& operator=(const translationGraph&) = delete;
+  ~translationGraph() { release(); }
+
+  // Split 'str' at the runs of separators as 're.split' does: a separator at either end gives an empty part there
+  template <typename Callback>
+  static void splitRuns(std::string_view str, const charClass& separators, Callback&& callback) {
+    size_t begin = 0;
+    for (size_t index = 0, size = str.size(); ; ) {
+      while ((index != size) && (!separators(str[index])))
+        ++index;
+      callback(str.substr(begin, index - begin));
+      if (index == size)
+        return;
+      while ((index != size) && separators(str[index]))
+        ++index;
+      begin = index;
+    }
+  }
+
+  // Split an English common name into its parts, the tokens being the parts transliterated and lowercased
+  static void splitEnglish(std::string_view commonName, std::string& name, VS& tokens) {
+    name.clear();
+    bool first = true;
+    splitRuns(commonName, englishSeparators, [&name, &first](std::string_view part) {
+      if (!first)
+        name += ' ';
+      name += part;
+      first = false;
+    });
+    splitRuns(foldToLower(commonName), englishSeparators, [&tokens](std::string_view part) { tokens.emplace_back(part); });
+  }
+
+  // Split a line of the target list into its parts, without its unique id
+  static void splitTarget(std::string_view line, std::string& name, VS& tokens) {
+    VS parts;
+    splitRuns(line, targetSeparators, [&parts](std::string_view part) { parts.emplace_back(part); });
+    parts.pop_back();
+    name.clear();
+    for (auto& part : parts) {
+      if (&part != &parts.front())
+        name += ' ';
+      name += part;
+      tokens.push_back(foldToLower(part));
+    }
+  }
+
+  // Map the graph in 'fileName'. Fails if the file is missing, corrupt or of another version
+  bool open(const std::string& fileName) {
+    release();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size < static_cast<off_t>(sizeof(header)))) {
+      close(fd);
+      return false;
+    }
+    void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+      return false;
+    mappedSize = info.st_size;
+    base = static_cast<const char*>(addr);
+    if (!attach(base, mappedSize)) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  // Build the graph: 'matched[u]' lists the target rows matched to English row 'u', as in the graph in text
+  void build(const std::vector<VI>& matched, const translationSide& englishSide, const translationSide& targetSide) {
+    release();
+    const translationSide* inputs[2] = {&englishSide, &targetSide};
+
+    // The translator chains the edges in front of the adjacency lists, thus visits them last inserted first
+    std::vector<VI> adjacency[2];
+    adjacency[english].resize(englishSide.size());
+    adjacency[target].resize(targetSide.size());
+    for (uint32_t u = 0; u != matched.size(); ++u) {
+      for (auto v : matched[u]) {
+        if ((u >= englishSide.size()) || (v >= targetSide.size()))
+          continue;
+        adjacency[english][u].push_back(v);
+        adjacency[target][v].push_back(u);
+      }
+    }
+    for (auto& lists : adjacency)
+      for (auto& list : lists)
+        std::reverse(list.begin(), list.end());
+
+    // The sorted tokens of each side, with the rows containing them
+    std::vector<std::pair<std::string_view, VI>> tokens[2];
+    for (unsigned index = 0; index != 2; ++index) {
+      std::unordered_map<std::string_view, uint32_t> ids;
+      auto& input = *inputs[index];
+      for (uint32_t row = 0; row != input.size(); ++row) {
+        for (auto& token : input.tokens[row]) {
+          auto [pos, inserted] = ids.emplace(token, tokens[index].size());
+          if (inserted)
+            tokens[index].emplace_back(token, VI());
+          tokens[index][pos->second].second.push_back(row);
+        }
+      }
+      std::sort(tokens[index].begin(), tokens[index].end());
+    }
+
+    // The BK-Tree over the tokens of each side, bulk-loaded in the order of the tokens
+    metricTree trees[2];
+    for (unsigned index = 0; index != 2; ++index) {
+      std::vector<std::string_view> keys;
+      for (auto& [token, rows] : tokens[index])
+        keys.push_back(token);
+      trees[index] = metricTree(keys, std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+
+    // Reserve the sections
+    uint64_t size = sizeof(header);
+    auto reserve = [&size](section& s, uint64_t count, size_t elemSize) -> void {
+      size = (size + 7) & ~uint64_t(7);
+      s.offset = size;
+      s.count = count;
+      size += count * elemSize;
+    };
+    auto charCount = [](const VS& strings) -> uint64_t {
+      uint64_t count = 0;
+      for (auto& str : strings)
+        count += str.size();
+      return count;
+    };
+    for (unsigned index = 0; index != 2; ++index) {
+      auto& s = h.sides[index];
+      auto& input = *inputs[index];
+      uint64_t neighborCount = 0, tokenCharCount = 0, postingCount = 0;
+      for (auto& list : adjacency[index])
+        neighborCount += list.size();
+      for (auto& [token, rows] : tokens[index]) {
+        tokenCharCount += token.size();
+        postingCount += rows.size();
+      }
+      reserve(s.neighborOffsets, input.size() + 1, 4);
+      reserve(s.neighbors, neighborCount, 4);
+      reserve(s.tokenOffsets, tokens[index].size() + 1, 4);
+      reserve(s.tokenChars, tokenCharCount, 1);
+      reserve(s.postingOffsets, tokens[index].size() + 1, 4);
+      reserve(s.postings, postingCount, 4);
+      reserve(s.treeNodes, trees[index].view().size(), sizeof(treeNode));
+      reserve(s.treeEdges, trees[index].view().n_edges(), sizeof(treeEdge));
+      reserve(s.nameOffsets, input.size() + 1, 4);
+      reserve(s.nameChars, charCount(input.names), 1);
+      reserve(s.rawOffsets, input.size() + 1, 4);
+      reserve(s.rawChars, charCount(input.raws), 1);
+    }
+    buffer.assign((size + 7) & ~uint64_t(7), 0);
+
+    // And fill them in
+    char* bytes = buffer.data();
+    auto sectionAt = [bytes](const section& s) -> char* { return bytes + s.offset; };
+    auto fillRuns = [&sectionAt](const section& offsetSection, const section& valueSection, size_t count, auto&& runAt) -> void {
+      auto offsets = reinterpret_cast<uint32_t*>(sectionAt(offsetSection));
+      auto values = sectionAt(valueSection);
+      offsets[0] = 0;
+      for (size_t index = 0; index != count; ++index) {
+        const auto& run = runAt(index);
+        size_t elemSize = sizeof(run[0]);
+        memcpy(values + offsets[index] * elemSize, run.data(), run.size() * elemSize);
+        offsets[index + 1] = offsets[index] + run.size();
+      }
+    };
+    memcpy(bytes, &h, sizeof(h));
+    for (unsigned index = 0; index != 2; ++index) {
+      auto& s = h.sides[index];
+      auto& input = *inputs[index];
+      auto& sideTokens = tokens[index];
+      fillRuns(s.neighborOffsets, s.neighbors, input.size(), [&](size_t row) -> const VI& { return adjacency[index][row]; });
+      fillRuns(s.tokenOffsets, s.tokenChars, sideTokens.size(), [&](size_t token) -> std::string_view { return sideTokens[token].first; });
+      fillRuns(s.postingOffsets, s.postings, sideTokens.size(), [&](size_t token) -> const VI& { return sideTokens[token].second; });
+      auto tree = trees[index].view();
+      memcpy(sectionAt(s.treeNodes), tree.nodes(), tree.size() * sizeof(treeNode));
+      memcpy(sectionAt(s.treeEdges), tree.edges(), tree.n_edges() * sizeof(treeEdge));
+      fillRuns(s.nameOffsets, s.nameChars, input.size(), [&](size_t row) -> const std::string& { return input.names[row]; });
+      fillRuns(s.rawOffsets, s.rawChars, input.size(), [&](size_t row) -> const std::string& { return input.raws[row]; });
+    }
+
+    attach(buffer.data(), buffer.size());
+  }
+
+  // Write the graph into 'fileName', replacing it at once
+  bool save(const std::string& fileName) const {
+    if (!head)
+      return false;
+    // Unique to the process, as for the snapshots: a merge may write the graph next to another run rewriting it
+    std::string tempFileName = fileName + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream output(tempFileName, std::ios::binary | std::ios::trunc);
+      size_t size = mappedSize ? mappedSize : buffer.size();
+      output.write(base, size);
+      if (!output) {
+        output.close();
+        remove(tempFileName.c_str());
+        return false;
+      }
+    }
+    if (rename(tempFileName.c_str(), fileName.c_str())) {
+      remove(tempFileName.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t rowCount(side s) const {
+    return sides[s].rowCount;
+  }
+
+  std::string_view name(side s, uint32_t row) const {
+    return (row < sides[s].rowCount) ? stringAt(sides[s].nameOffsets, sides[s].nameChars, row) : std::string_view();
+  }
+
+  std::string_view raw(side s, uint32_t row) const {
+    return (row < sides[s].rowCount) ? stringAt(sides[s].rawOffsets, sides[s].rawChars, row) : std::string_view();
+  }
+
+  // The rows of side 's' containing 'token' (a binary search over the sorted tokens)
+  std::pair<const uint32_t*, const uint32_t*> rowsOf(side s, std::string_view token) const {
+    auto& view = sides[s];
+    uint32_t first = 0, count = view.tokenCount;
+    while (count) {
+      uint32_t step = count / 2;
+      if (stringAt(view.tokenOffsets, view.tokenChars, first + step) < token) {
+        first += step + 1;
+        count -= step + 1;
+      } else {
+        count = step;
+      }
+    }
+    if ((first == view.tokenCount) || (stringAt(view.tokenOffsets, view.tokenChars, first) != token))
+      return {nullptr, nullptr};
+    return {view.postings + view.postingOffsets[first], view.postings + view.postingOffsets[first + 1]};
+  }
+
+  // Translate 'medicine', written in the language of side 's', as 'Translator.query' does: the rows of the other side
+  // adjacent to the most rows containing the parts of 'medicine' (each counted once per part when there are several parts,
+  // at least half of which have to be found), in the order in which they were first reached.
+  // As in 'Matcher::solveSplittedCase', a part not found as such (of at least MIN_LEN chars, not a number) stands for the tokens
+  // within SEARCH_PRECISION of it, and the rows reached as often are told apart by their closeness. 'scores' is scratch
+  void query(side s, std::string_view medicine, scoringWorkspace& scores, VI& best) const {
+    thread_local treeMatches similar;
+    best.clear();
+    std::vector<std::string_view> parts;
+    std::string casted = foldToLower(trimSpaces(medicine));
+    splitRuns(casted, querySeparators, [&parts](std::string_view part) { parts.push_back(part); });
+
+    auto& view = sides[s];
+    scores.reset(sides[1 - s].rowCount);
+    uint32_t found = 0;
+    auto addRows = [&](const uint32_t* first, const uint32_t* last, uint32_t distance) -> void {
+      for (; first != last; ++first) {
+        for (uint32_t pos = view.neighborOffsets[*first]; pos != view.neighborOffsets[*first + 1]; ++pos) {
+          uint32_t row = view.neighbors[pos];
+          if ((parts.size() == 1) || (scores.firstInPart(row)))
+            scores.add(row, distance);
+        }
+      }
+    };
+    for (auto part : parts) {
+      auto [first, last] = rowsOf(s, part);
+      if (first) {
+        ++found;
+        scores.nextPart();
+        addRows(first, last, 0);
+        continue;
+      }
+      if ((part.length() < MIN_LEN) || (hasOnlyDigits(part)))
+        continue;
+      similar.clear();
+      view.tree.find_within(similar, part, SEARCH_PRECISION);
+      if (similar.empty())
+        continue;
+      ++found;
+      scores.nextPart();
+      for (auto token : similar)
+        addRows(view.postings + view.postingOffsets[token.node], view.postings + view.postingOffsets[token.node + 1], token.distance);
+    }
+
+    // Several parts need at least half of them (strictly more than half of an odd count, both of two), doubled to stay integral
+    uint32_t lowerBound = 0;
+    if (parts.size() > 1) {
+      lowerBound = parts.size() + 2 * ((parts.size() % 2 == 1) || (parts.size() == 2));
+      if (2 * found < lowerBound)
+        return;
+    }
+    uint32_t maxCount = 0, minCloseness = 0;
+    for (auto row : scores.touched()) {
+      uint32_t count = scores.count(row), closeness = scores.closeness(row);
+      if ((count > maxCount) || ((count == maxCount) && (closeness < minCloseness))) {
+        best.clear();
+        maxCount = count;
+        minCloseness = closeness;
+      }
+      if ((count == maxCount) && (closeness == minCloseness))
+        best.push_back(row);
+    }
+    if (2 * maxCount < lowerBound)
+      best.clear();
+  }
+};
+
+// Whether the rows of 'databankFileName' have their Drugbank ids (the vocabulary does, en_meds.csv does not)
+inline bool hasDrugbankIds(const std::string& databankFileName) {
+  drugbankReader rows;
+  drugbankRecord row;
+  return (rows.open(databankFileName)) && (rows.next(row)) && (!row.id.empty());
+}
+
+// The English medicines of the translator: the rows of the database file which has been matched, each with its common name (transliterated)
+// and its Drugbank id. The ids are those of the vocabulary, either the database file itself or, for en_meds.csv, 'vocabularyFileName',
+// the vocabulary it has been parsed from (row for row). Fails if a file could not be read, if the rows have no ids and no vocabulary is given
+// (the names do not stand for the ids: the translator links the medicines by them), or if the vocabulary does not have the rows of the database file
+inline bool readEnglishSide(const std::string& databankFileName, const std::string& vocabularyFileName, translationSide& side) {
+  drugbankReader rows;
+  if (!rows.open(databankFileName)) {
+    std::cerr << "file \"" << databankFileName << "\" could not open" << std::endl;
+    return false;
+  }
+  std::string name;
+  for (drugbankRecord row; rows.next(row); ) {
+    if ((row.id.empty()) && (vocabularyFileName.empty())) {
+      std::cerr << "file \"" << databankFileName << "\" has no Drugbank ids, give its vocabulary with --vocabulary" << std::endl;
+      return false;
+    }
+    VS tokens;
+    translationGraph::splitEnglish(row.commonName, name, tokens);
+    side.add(name, std::string(row.id), std::move(tokens));
+  }
+  if (vocabularyFileName.empty())
+    return true;
+
+  drugbankReader vocabulary;
+  if (!vocabulary.open(vocabularyFileName)) {
+    std::cerr << "file \"" << vocabularyFileName << "\" could not open" << std::endl;
+    return false;
+  }
+  uint32_t row = 0;
+  for (drugbankRecord entry; vocabulary.next(entry); ++row) {
+    if ((row == side.size()) || (entry.id.empty())) {
+      std::cerr << "file \"" << vocabularyFileName << "\" is not the vocabulary of \"" << databankFileName << "\"" << std::endl;
+      return false;
+    }
+    side.raws[row] = std::string(entry.id);
+  }
+  if (row != side.size()) {
+    std::cerr << "file \"" << vocabularyFileName << "\" is not the vocabulary of \"" << databankFileName << "\"" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Build the graph of the translator from the matching of the rows of 'databankFileName' into the list of 'language',
+// the target rows of each row being in 'matched'. Fails if a file could not be read, or if the matching does not fit the lists
+inline bool buildTranslationGraph(const std::string& language, const std::string& databankFileName, const std::string& vocabularyFileName,
+                                  std::vector<VI> matched, translationGraph& graph) {
+  translationSide englishSide, targetSide;
+  if (!readEnglishSide(databankFileName, vocabularyFileName, englishSide))
+    return false;
+
+  // The medicines of the target language
+  std::ifstream input(medsFileName(language));
+  if (!input.is_open()) {
+    std::cerr << "file \"" << medsFileName(language) << "\" could not open" << std::endl;
+    return false;
+  }
+  std::string name;
+  for (std::string line; std::getline(input, line); ) {
+    VS tokens;
+    auto stripped = trimSpaces(line);
+    translationGraph::splitTarget(stripped, name, tokens);
+    targetSide.add(name, std::string(stripped), std::move(tokens));
+  }
+
+  // A matching of other lists would give a graph of unrelated medicines
+  for (uint32_t u = 0; u != matched.size(); ++u) {
+    auto beyond = std::find_if(matched[u].begin(), matched[u].end(), [&targetSide](uint32_t v) { return v >= targetSide.size(); });
+    if ((u >= englishSide.size()) || (beyond != matched[u].end())) {
+      std::cerr << "the matching does not fit \"" << databankFileName << "\" and \"" << medsFileName(language) << "\"" << std::endl;
+      return false;
+    }
+  }
+  matched.resize(englishSide.size());
+
+  graph.build(matched, englishSide, targetSide);
+  return true;
+}
+
+// The same, with the matching written in text into 'matchedFileName', a line "<row> <target rows>.." per matched row
+// (a ranked target row being followed by ":<score>")
+inline bool buildTranslationGraph(const std::string& language, const std::string& databankFileName, const std::string& vocabularyFileName,
+                                  const std::string& matchedFileName, translationGraph& graph) {
+  std::ifstream matchedInput(matchedFileName);
+  if (!matchedInput.is_open()) {
+    std::cerr << "file \"" << matchedFileName << "\" could not open" << std::endl;
+    return false;
+  }
+  std::vector<VI> matched;
+  for (std::string line; std::getline(matchedInput, line); ) {
+    std::istringstream edges(line);
+    uint32_t u;
+    if (!(edges >> u))
+      continue;
+    if (u >= matched.size())
+      matched.resize(u + 1);
+    for (std::string edge; edges >> edge; )
+      matched[u].push_back(strtoul(edge.c_str(), nullptr, 10));
+  }
+  return buildTranslationGraph(language, databankFileName, vocabularyFileName, std::move(matched), graph);
+}
+
+#endif /* _TRANSLATION_GRAPH_HPP_ */
@@ -0,0 +1,49 @@
+#include <cstring>
+#include "translation_graph.hpp"
+
+// The queries of the translator (translator.py) on the binary graph written by 'match', through a C interface for ctypes.
+// A handle owns the mapped graph; the names returned point into the mapping, thus stay valid until the handle is closed.
+// The queries may run concurrently on the same handle (each thread scores in its own workspace)
+
+extern "C" {
+
+// Map the graph in 'fileName'. Returns the handle, NULL if the file is missing or corrupt
+void* langsome_open(const char* fileName) {
+  auto graph = new translationGraph();
+  if (!graph->open(fileName)) {
+    delete graph;
+    return nullptr;
+  }
+  return graph;
+}
+
+void langsome_close(void* handle) {
+  delete static_cast<translationGraph*>(handle);
+}
+
+// Translate 'medicine', written in the language of side 'side' (0 for English, 1 for the target language), into the rows of the other side.
+// The first 'capacity' of them are written into 'rows'. Returns their number, which may exceed 'capacity' (the caller then asks again)
+uint32_t langsome_query(void* handle, uint32_t side, const char* medicine, uint32_t* rows, uint32_t capacity) {
+  thread_local scoringWorkspace scores;
+  thread_local VI best;
+  auto graph = static_cast<const translationGraph*>(handle);
+  graph->query(side ? translationGraph::target : translationGraph::english, medicine, scores, best);
+  memcpy(rows, best.data(), std::min<size_t>(capacity, best.size()) * sizeof(uint32_t));
+  return best.size();
+}
+
+// The name of 'row' on side 'side', as shown by the translator, and its raw name (the Drugbank id, the line of the list).
+// The names are not null-terminated: their length is written into 'length'
+const char* langsome_name(void* handle, uint32_t side, uint32_t row, size_t* length) {
+  auto name = static_cast<const translationGraph*>(handle)->name(side ? translationGraph::target : translationGraph::english, row);
+  *length = name.size();
+  return name.data();
+}
+
+const char* langsome_raw(void* handle, uint32_t side, uint32_t row, size_t* length) {
+  auto raw = static_cast<const translationGraph*>(handle)->raw(side ? translationGraph::target : translationGraph::english, row);
+  *length = raw.size();
+  return raw.data();
+}
+
+}
@@ -0,0 +1,206 @@
+# Generator of synthetic corpora, shaped like the real lists but of any size, for the scaling and throughput tests of the matcher.
+# It learns from meds/en_meds.csv and meds/refs/list_*:
+# - the number of tokens of the common names, synonyms, prices and German names, and the lengths of the tokens,
+# - the number of synonyms and prices of a row, and how often a synonym starts like the common name,
+# - the frequent tokens of each kind of name (e.g. "mg", "Tabletten"), the others being invented by a character model,
+# - how often a German name starts with a token of an English common name, and the digits of the ids ("_<id>").
+# The German names derived from the English rows carry a 1-edit typo at the rate given by --typo-rate.
+# The same seed and arguments give the same corpus.
+# Example: python3 parser/synthetic.py --scale 10 --output meds/synthetic/10
+#          cd matcher && ./match ../meds/synthetic/10/en_meds.csv --meds ../meds/synthetic/10
+#          ./benchmark ../meds/synthetic/10/en_meds.csv bench.10.json ../meds/synthetic/10
+import os
+import csv
+import random
+import argparse
+from collections import Counter
+
+# Tokens seen at least this often are reused as they are, the others are invented
+FREQUENT_COUNT = 3
+# The order of the character model
+ORDER = 2
+
+class Distribution:
+  # An empirical distribution, sampled with the generator of the corpus
+  def __init__(self, counter):
+    self.values = sorted(counter)
+    self.weights = []
+    total = 0
+    for value in self.values:
+      total += counter[value]
+      self.weights.append(total)
+
+  def sample(self, rng):
+    return rng.choices(self.values, cum_weights = self.weights)[0]
+
+class TokenModel:
+  # The tokens of one kind of name: the frequent ones are reused, the others invented with the lengths of the real ones
+  def __init__(self, tokens):
+    counts = Counter(tokens)
+    frequent = Counter({token : count for (token, count) in counts.items() if count >= FREQUENT_COUNT})
+    rare = [token for token in tokens if counts[token] < FREQUENT_COUNT]
+    self.frequentRate = (len(tokens) - len(rare)) / max(1, len(tokens))
+    self.frequent = Distribution(frequent) if frequent else None
+    self.lengths = Distribution(Counter(len(token) for token in rare)) if rare else Distribution(Counter([6]))
+
+    # The next char after each context of ORDER chars ("^" pads the start)
+    transitions = {}
+    for token in (rare if rare else tokens):
+      padded = "^" * ORDER + token
+      for index in range(ORDER, len(padded)):
+        transitions.setdefault(padded[index - ORDER : index], Counter())[padded[index]] += 1
+    self.transitions = {context : Distribution(counter) for (context, counter) in transitions.items()}
+    self.fallback = Distribution(Counter("".join(rare if rare else tokens)))
+
+  def invent(self, rng, length):
+    token = "^" * ORDER
+    while len(token) - ORDER < length:
+      distribution = self.transitions.get(token[-ORDER:], self.fallback)
+      token += distribution.sample(rng)
+    return token[ORDER:]
+
+  def sample(self, rng):
+    if self.frequent and rng.random() < self.frequentRate:
+      return self.frequent.sample(rng)
+    return self.invent(rng, self.lengths.sample(rng))
+
+def typo(token, rng):
+  # One random insertion, deletion or substitution
+  position = rng.randrange(len(token) + 1)
+  char = rng.choice("abcdefghijklmnopqrstuvwxyz")
+  kind = rng.randrange(3)
+  if kind == 0 or position == len(token):
+    return token[:position] + char + token[position:]
+  if kind == 1 and len(token) > 1:
+    return token[:position] + token[(position + 1):]
+  return token[:position] + char + token[(position + 1):]
+
+def splitRow(field):
+  # Split the second field of en_meds.csv into its synonyms (joined by " | ") and its prices (appended with bare bars)
+  synonyms, prices = [], []
+  for index, elem in enumerate(field.split("|")):
+    if index == 0 or elem.startswith(" "):
+      if elem.strip():
+        synonyms.append(elem.strip())
+    else:
+      prices.append(elem)
+  return synonyms, prices
+
+class Corpus:
+  # What is learned from the real lists
+  def __init__(self, medsDirectory):
+    commonTokens, synonymTokens, priceTokens, germanTokens, leadTokens = [], [], [], [], []
+    commonCounts, synonymCounts, priceCounts, germanCounts = Counter(), Counter(), Counter(), Counter()
+    synonymsPerRow, pricesPerRow, idDigits = Counter(), Counter(), Counter()
+    firstTokens = set()
+    sharedSynonyms, synonymTotal = 0, 0
+    with open(os.path.join(medsDirectory, "en_meds.csv"), "r") as input:
+      for row in csv.reader(input):
+        commonName = row[0].split()
+        synonyms, prices = splitRow(row[1] if len(row) > 1 else "")
+        commonTokens += commonName
+        commonCounts[len(commonName)] += 1
+        if commonName:
+          firstTokens.add(commonName[0].lower())
+        synonymsPerRow[len(synonyms)] += 1
+        pricesPerRow[len(prices)] += 1
+        for synonym in synonyms:
+          tokens = synonym.split()
+          synonymTokens += tokens
+          synonymCounts[len(tokens)] += 1
+          synonymTotal += 1
+          sharedSynonyms += int(bool(commonName) and tokens[0].lower() == commonName[0].lower())
+        for price in prices:
+          tokens = price.split()
+          priceTokens += tokens
+          priceCounts[len(tokens)] += 1
+
+    derived, germanTotal = 0, 0
+    refs = os.path.join(medsDirectory, "refs")
+    for file in sorted(os.listdir(refs)):
+      if not file.startswith("list_"):
+        continue
+      with open(os.path.join(refs, file), "r") as input:
+        # The first line is the number of pages of the list
+        next(input)
+        for line in input:
+          name, _, id = line.strip().rpartition("_")
+          tokens = [token for token in name.split("-") if token]
+          if not tokens:
+            continue
+          germanTokens += tokens[1:]
+          germanCounts[len(tokens)] += 1
+          idDigits[len(id)] += 1
+          germanTotal += 1
+          if tokens[0].lower() in firstTokens:
+            derived += 1
+          else:
+            leadTokens.append(tokens[0])
+
+    self.rowCount = sum(commonCounts.values())
+    self.germanCount = germanTotal
+    self.common, self.synonym, self.price = TokenModel(commonTokens), TokenModel(synonymTokens), TokenModel(priceTokens)
+    self.german, self.lead = TokenModel(germanTokens), TokenModel(leadTokens)
+    self.commonCounts, self.synonymCounts, self.priceCounts = Distribution(commonCounts), Distribution(synonymCounts), Distribution(priceCounts)
+    self.germanCounts = Distribution(germanCounts)
+    self.synonymsPerRow, self.pricesPerRow, self.idDigits = Distribution(synonymsPerRow), Distribution(pricesPerRow), Distribution(idDigits)
+    self.sharedRate = sharedSynonyms / max(1, synonymTotal)
+    self.derivedRate = derived / max(1, germanTotal)
+
+  def englishRow(self, rng):
+    # The common name, then its synonyms and prices, as en_parser.py writes them
+    commonName = [self.common.sample(rng) for _ in range(self.commonCounts.sample(rng))]
+    synonyms = []
+    for _ in range(self.synonymsPerRow.sample(rng)):
+      tokens = [self.synonym.sample(rng) for _ in range(self.synonymCounts.sample(rng))]
+      if rng.random() < self.sharedRate:
+        tokens[0] = commonName[0]
+      synonyms.append(" ".join(tokens))
+    prices = [" ".join(self.price.sample(rng) for _ in range(self.priceCounts.sample(rng))) for _ in range(self.pricesPerRow.sample(rng))]
+    field = " | ".join(synonyms)
+    if prices:
+      field += "|" + "|".join(prices)
+    return [" ".join(commonName), field]
+
+  def germanName(self, rng, rows, typoRate):
+    # A German name, which starts with the common name of an English row at the learned rate
+    tokens = [self.german.sample(rng) for _ in range(self.germanCounts.sample(rng))]
+    if rows and rng.random() < self.derivedRate:
+      first = rng.choice(rows)[0].split()[0]
+      tokens[0] = typo(first, rng) if rng.random() < typoRate else first
+    else:
+      tokens[0] = self.lead.sample(rng)
+    id = str(rng.randrange(1, 10)) + "".join(rng.choice("0123456789") for _ in range(self.idDigits.sample(rng) - 1))
+    return "-".join(tokens) + "_" + id
+
+def main():
+  args = argparse.ArgumentParser(description = "Generate a synthetic corpus (en_meds.csv and de_meds.csv) shaped like the real lists")
+  args.add_argument("--scale", type = float, default = 1.0, help = "the size relative to the real lists")
+  args.add_argument("--rows", type = int, help = "the number of English rows (instead of the scale)")
+  args.add_argument("--names", type = int, help = "the number of German names (instead of the scale)")
+  args.add_argument("--typo-rate", type = float, default = 0.05, help = "the share of the derived German names with a 1-edit typo")
+  args.add_argument("--seed", type = int, default = 42)
+  args.add_argument("--meds", default = "meds", help = "the directory of the real lists")
+  args.add_argument("--output", default = os.path.join("meds", "synthetic"))
+  options = args.parse_args()
+
+  corpus = Corpus(options.meds)
+  rowCount = options.rows if options.rows is not None else round(corpus.rowCount * options.scale)
+  nameCount = options.names if options.names is not None else round(corpus.germanCount * options.scale)
+  rng = random.Random(options.seed)
+
+  os.makedirs(options.output, exist_ok = True)
+  rows = [corpus.englishRow(rng) for _ in range(rowCount)]
+  with open(os.path.join(options.output, "en_meds.csv"), "w", newline="") as output:
+    csv.writer(output, lineterminator="\n").writerows(rows)
+
+  # The lists of Gelbe Liste are sorted by name
+  names = sorted(corpus.germanName(rng, rows, options.typo_rate) for _ in range(nameCount))
+  with open(os.path.join(options.output, "de_meds.csv"), "w") as output:
+    for name in names:
+      output.write(name + "\n")
+  print("Written " + str(rowCount) + " rows and " + str(nameCount) + " German names into " + options.output)
+  pass
+
+if __name__ == '__main__':
+  main()
@@ -1,5 +1,6 @@
 import re
 import csv
+import ctypes
 from unidecode import unidecode
 
 # The translator
@@ -28,9 +29,54 @@ class Translator:
         pos = self.staticList[pos][1]
       return ret
 
+  # The queries on the binary graph written by the matcher (matcher/graph.bin), mapped by the library built with 'make' in matcher/
+  class Native:
+    def __init__(self, libraryPath, graphPath):
+      self.lib = ctypes.CDLL(libraryPath)
+      self.lib.langsome_open.restype = ctypes.c_void_p
+      self.lib.langsome_open.argtypes = [ctypes.c_char_p]
+      self.lib.langsome_close.argtypes = [ctypes.c_void_p]
+      self.lib.langsome_query.restype = ctypes.c_uint32
+      self.lib.langsome_query.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p, ctypes.POINTER(ctypes.c_uint32), ctypes.c_uint32]
+      for function in (self.lib.langsome_name, self.lib.langsome_raw):
+        function.restype = ctypes.c_void_p
+        function.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32, ctypes.POINTER(ctypes.c_size_t)]
+      self.handle = self.lib.langsome_open(graphPath.encode())
+      if not self.handle:
+        raise OSError("graph \"" + graphPath + "\" could not be mapped")
+      self.rows = (ctypes.c_uint32 * 64)()
+
+    def __del__(self):
+      if getattr(self, "handle", None):
+        self.lib.langsome_close(self.handle)
+
+    def string(self, function, side, row):
+      length = ctypes.c_size_t()
+      ptr = function(self.handle, side, row, ctypes.byref(length))
+      return ctypes.string_at(ptr, length.value).decode("utf-8", "replace")
+
+    def query(self, side, medicine):
+      encoded = medicine.encode("utf-8")
+      count = self.lib.langsome_query(self.handle, side, encoded, self.rows, len(self.rows))
+      if count > len(self.rows):
+        self.rows = (ctypes.c_uint32 * count)()
+        count = self.lib.langsome_query(self.handle, side, encoded, self.rows, len(self.rows))
+      if not count:
+        return []
+      other = int(not side)
+      best = self.rows[:count]
+      return [[self.string(self.lib.langsome_name, other, row) for row in best], [self.string(self.lib.langsome_raw, other, row) for row in best]]
+
   def __init__(self):
     self.invalid = {"", "g", "mg", "mcg", "ml", "mikrogramm", "unit"}
 
+    # Map the binary graph if the matcher has written it, and otherwise build the graph from the lists
+    try:
+      self.native = self.Native("matcher/libtranslator.so", "matcher/graph.bin")
+      return
+    except OSError:
+      self.native = None
+
     leftSize = sum(1 for line in open('meds/en_meds.csv', "r"))
     rightSize = sum(1 for line in open('meds/de_meds.csv', "r"))
     
@@ -41,7 +87,7 @@ class Translator:
         args = row.split()
         u = int(args[0])
         for v in args[1:]:
-          self.graph.addEdge(u, int(v))
+          self.graph.addEdge(u, int(v.split(":")[0]))
           
     # Store the medicines (en, de)
     self.medIndex = [dict(), dict()]
@@ -105,6 +151,8 @@ class Translator:
   def query(self, targetLanguage, medicine):
     if not medicine:
       return ""
+    if self.native:
+      return self.native.query(int(targetLanguage == "English"), medicine)
     medicine = unidecode(medicine.strip()).lower()
     splitted = re.split("[\\s,/-]+", medicine)
     side = int(targetLanguage == "English")